@@ -0,0 +1,68 @@
+/* gcc -g -O2 -W -Wall -std=c11 -pedantic -Wshadow -Wcast-qual -Wconversion -Wwrite-strings -fno-builtin -D XT_X_SPILL=0 -pthread -o packtest packtest.c -ldl -lm
+ *
+ * Checks that every block XT_Pack() compresses is given back as it was by
+ * XT_Unpack(), for random blocks (which do not compress), repetitive ones
+ * (which compress to almost nothing) and a mix of the two, and that a block
+ * too big for the buffer it is unpacked into is reported rather than written
+ * past its end.  Run by "make check".
+ */
+
+#include "xt.c"                        /* The codec is internal to the library. */
+
+
+static unsigned char  in [XT_SPILL_BLOCK];
+static unsigned char  packed [XT_PACK_MAX (XT_SPILL_BLOCK)];
+static unsigned char  out [XT_SPILL_BLOCK];
+
+
+
+static int RoundTrip (const char *pName, size_t n)
+{
+    size_t   size, got;
+
+    size = XT_Pack (in, n, packed);
+    got = XT_Unpack (packed, size, out, n);
+    printf ("%-12s %6zu bytes packed to %6zu\n", pName, n, size);
+    if (size > XT_PACK_MAX (n) || got != n || memcmp (in, out, n) != 0)
+    {
+        printf ("%s: %zu bytes did not unpack as they were\n", pName, n);
+        return (1);
+    }
+    if (n > 0 && XT_Unpack (packed, size, out, n - 1) != n)
+    {
+        printf ("%s: %zu bytes unpacked into a smaller buffer\n", pName, n);
+        return (1);
+    }
+    return (0);
+}
+
+
+
+int main (void)
+{
+    static const size_t  sizes [] = {0, 1, 4, 15, 16, 19, 270, 4096, XT_SPILL_BLOCK};
+    size_t   i, k;
+    int      failed = 0;
+
+    srand (1);
+    for (k = 0;  k < sizeof (sizes) / sizeof (sizes [0]);  k++)
+    {
+        for (i = 0;  i < sizes [k];  i++)
+            in [i] = (unsigned char) rand ();
+        failed |= RoundTrip ("random", sizes [k]);
+
+        memset (in, 0, sizes [k]);
+        failed |= RoundTrip ("zeros", sizes [k]);
+
+        for (i = 0;  i < sizes [k];  i++)
+            in [i] = (unsigned char) "call tree "[i % 10];
+        failed |= RoundTrip ("repeated", sizes [k]);
+
+        for (i = 0;  i < sizes [k];  i++)
+            in [i] = (unsigned char) (((i / 64) % 2 == 0) ? rand () : (int) (i % 7));
+        failed |= RoundTrip ("mixed", sizes [k]);
+    }
+
+    printf ("%s\n", (failed != 0) ? "FAILED" : "All blocks unpacked as they were");
+    return (failed);
+}
@@ -0,0 +1,86 @@
+/*
+ * xt-ctl.c
+ *  Inspect a running program traced by the Execution Trace library.
+ *  Copyright (C) 2020  Peter Harris   dilbert351@gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  Usage:  xt-ctl pid request [argument]
+ *
+ *    stacks       The functions each thread is running, outermost first, and
+ *                 how long each has been running.
+ *    top [N]      The N functions with the most self time so far (default 10).
+ *    memory       The memory used by the trace library.
+ *    dropped      The number of calls the library could not record.
+ *
+ *  The program must have been built with "make USE_XT=1 CONTROL=1".  The
+ *  request is sent to the socket /tmp/xt-<pid>.sock and the reply printed.
+ *  The exit status is 0 on success and 1 if the program could not be reached.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>             // printf() fprintf() snprintf() fwrite()
+#include <string.h>            // strlen() strncpy() memset()
+#include <stdlib.h>            // atoi()
+#include <unistd.h>            // read() write() close()
+#include <sys/socket.h>        // socket() connect() shutdown()
+#include <sys/un.h>            // struct sockaddr_un
+
+
+#define XT_CTL_PATH      "/tmp/xt-%d.sock"    /* Must match the name used in xt.h.       */
+
+
+
+
+int main (int argc, char *argv [])
+{
+    struct sockaddr_un  addr;
+    char      req [128], buff [4096];
+    ssize_t   len;
+    int       fd, pid;
+
+    if (argc < 3 || (pid = atoi (argv [1])) <= 0)
+    {
+        fprintf (stderr, "Usage: xt-ctl pid stacks | top [N] | memory | dropped\n");
+        return (1);
+    }
+
+    memset (& addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    snprintf (addr.sun_path, sizeof (addr.sun_path), XT_CTL_PATH, pid);
+    snprintf (req, sizeof (req), "%s %s\n", argv [2], (argc > 3) ? argv [3] : "");
+
+    if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+        connect (fd, (struct sockaddr *) & addr, sizeof (addr)) != 0)
+    {
+        fprintf (stderr, "xt-ctl: cannot connect to %s\n", addr.sun_path);
+        return (1);
+    }
+
+    if (write (fd, req, strlen (req)) < 0)
+    {
+        fprintf (stderr, "xt-ctl: cannot send request\n");
+        close (fd);
+        return (1);
+    }
+    shutdown (fd, SHUT_WR);
+
+    while ((len = read (fd, buff, sizeof (buff))) > 0)
+        fwrite (buff, 1, (size_t) len, stdout);
+
+    close (fd);
+    return (0);
+}
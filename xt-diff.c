@@ -0,0 +1,323 @@
+/*
+ * xt-diff.c
+ *  Compare two Execution Trace profiles and report performance changes.
+ *  Copyright (C) 2020  Peter Harris   dilbert351@gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  Usage:  xt-diff [-t percent] [-a seconds] [-n lines] base.prof new.prof
+ *
+ *    -t percent   Smallest relative change reported (default 5%).
+ *    -a seconds   Smallest absolute time change reported (default 0.001).
+ *    -n lines     Maximum lines in each section, 0 for all (default 20).
+ *
+ *  Functions are compared by name (times summed over every path ending in the
+ *  function) followed by each individual call path.  Lines are sorted by the
+ *  size of the change in time, largest first.  A line is marked with '!' when
+ *  the total or self time has increased by more than both thresholds.
+ *
+ *  The exit status is 0 if there are no regressions, 1 if any were found and
+ *  2 if an error occurred, so the tool can be used to gate changes.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L // For getopt()
+
+#include <stdio.h>             // printf() fprintf()
+#include <string.h>            // strlen() strncmp()
+#include <stdlib.h>            // calloc() free() qsort() strtod() atoi()
+#include <unistd.h>            // getopt()
+#include <math.h>              // fabs()
+#include "xtprof.h"
+
+
+#define XT_DIFF_CALLS    0                    /* Field indices used internally.          */
+#define XT_DIFF_TOTAL    1
+#define XT_DIFF_SELF     2
+
+
+typedef struct xtdiffrow_
+{
+    const char  *pName;                       /* Function name or call path.            */
+    double       base [3];                    /* Calls, total, self in the base run.    */
+    double       cur  [3];                    /* Calls, total, self in the new run.     */
+    double       impact;                      /* Largest absolute change in time.       */
+    int          regress;                     /* Set if time increased significantly.   */
+}
+XTDiffRow;
+
+
+static double    xt_minPercent = 5.0;        /* Relative change threshold (%).         */
+static double    xt_minSeconds = 0.001;      /* Absolute change threshold (S).         */
+static unsigned  xt_maxLines   = 20;         /* Lines per section (0 = all).           */
+
+
+
+
+/*-----------------------------------------------------------------------------
+ * Returns non zero if the function at the end of the path also appears earlier
+ * in the path.  The total time of such recursive calls is already included in
+ * the outer call, so it must not be counted twice.
+ */
+
+static int XT_DiffRecursive (const char *pPath)
+{
+    const char  *pLeaf, *p;
+    size_t       len;
+
+    pLeaf = XT_ProfLeaf (pPath);
+    len = strlen (pLeaf);
+    for (p = pPath;  p < pLeaf;  p++)
+    {
+        if ((p == pPath || p [-1] == ';') && strncmp (p, pLeaf, len) == 0 && p [len] == ';')
+            return (1);
+    }
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Copy the calls, total and self fields of an entry (zero if missing) into an
+ * array using the field indices of the profile.
+ */
+
+static void XT_DiffValues (XTProfile *pProf, const XTProfEntry *pEntry, double *pValue)
+{
+    static const char  *names [3] = {"calls", "total", "self"};
+    int                 i, f;
+
+    for (i = 0;  i < 3;  i++)
+    {
+        f = XT_ProfField (pProf, names [i], 0);
+        pValue [i] = (pEntry != NULL && f >= 0) ? pEntry->value [f] : 0.0;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Build a profile holding one entry per function name from a profile of call
+ * paths.
+ */
+
+static int XT_DiffByName (XTProfile *pPaths, XTProfile *pFuncs)
+{
+    unsigned      n;
+    double        value [3];
+    XTProfEntry  *pEntry;
+
+    XT_ProfField (pFuncs, "calls", 1);
+    XT_ProfField (pFuncs, "total", 1);
+    XT_ProfField (pFuncs, "self", 1);
+
+    for (n = 0;  n < pPaths->nEntries;  n++)
+    {
+        XT_DiffValues (pPaths, & pPaths->pEntry [n], value);
+        if ((pEntry = XT_ProfFind (pFuncs, XT_ProfLeaf (pPaths->pEntry [n].pPath), 1)) == NULL)
+            return (-1);
+        pEntry->value [XT_DIFF_CALLS] += value [XT_DIFF_CALLS];
+        pEntry->value [XT_DIFF_SELF]  += value [XT_DIFF_SELF];
+        if (XT_DiffRecursive (pPaths->pEntry [n].pPath) == 0)
+            pEntry->value [XT_DIFF_TOTAL] += value [XT_DIFF_TOTAL];
+    }
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Returns non zero if the change from base to cur passes both thresholds.
+ */
+
+static int XT_DiffSignificant (double base, double cur, double minAbs)
+{
+    double    delta = fabs (cur - base);
+
+    return (delta > 0.0 && delta >= minAbs && delta * 100.0 >= xt_minPercent * fabs (base));
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * qsort() comparison: largest impact first, then by name for stable output.
+ */
+
+static int XT_DiffCompare (const void *p1, const void *p2)
+{
+    const XTDiffRow  *r1 = (const XTDiffRow *) p1;
+    const XTDiffRow  *r2 = (const XTDiffRow *) p2;
+
+    if (r1->impact != r2->impact)
+        return ((r1->impact < r2->impact) ? 1 : -1);
+    return (strcmp (r1->pName, r2->pName));
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print one time change as "+1.00 S (+50.0%)".
+ */
+
+static void XT_DiffPrintChange (double base, double cur)
+{
+    char    buff [32], time [16];
+
+    if (base == 0.0)
+        snprintf (buff, sizeof (buff), "%s (new)", XT_ProfTime (cur - base, time));
+    else if (cur == 0.0)
+        snprintf (buff, sizeof (buff), "%s (gone)", XT_ProfTime (cur - base, time));
+    else
+        snprintf (buff, sizeof (buff), "%s (%+.1f%%)", XT_ProfTime (cur - base, time),
+                  (cur - base) * 100.0 / base);
+    printf ("  %c%-22s", (cur >= base) ? '+' : ' ', buff);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Compare two profiles entry by entry and print the significant changes.
+ * Returns the number of regressions found, or -1 on error.
+ */
+
+static int XT_DiffSection (const char *pTitle, XTProfile *pBase, XTProfile *pCur)
+{
+    unsigned      n, nRows, nShown;
+    int           i, changed, regressions = 0;
+    XTDiffRow    *pRows, *pRow;
+    XTProfEntry  *pEntry;
+    XTProfile    *pProf;
+
+    pRows = (XTDiffRow *) calloc ((size_t) pBase->nEntries + pCur->nEntries + 1, sizeof (XTDiffRow));
+    if (pRows == NULL)
+        return (-1);
+
+    /* Every entry of the new profile, then entries only found in the base.
+     */
+    nRows = 0;
+    for (i = 0, pProf = pCur;  i < 2;  i++, pProf = pBase)
+    {
+        for (n = 0;  n < pProf->nEntries;  n++)
+        {
+            pEntry = & pProf->pEntry [n];
+            if (pProf == pBase && XT_ProfFind (pCur, pEntry->pPath, 0) != NULL)
+                continue;
+            pRow = & pRows [nRows];
+            pRow->pName = pEntry->pPath;
+            XT_DiffValues (pBase, XT_ProfFind (pBase, pEntry->pPath, 0), pRow->base);
+            XT_DiffValues (pCur, XT_ProfFind (pCur, pEntry->pPath, 0), pRow->cur);
+
+            changed = XT_DiffSignificant (pRow->base [XT_DIFF_CALLS], pRow->cur [XT_DIFF_CALLS], 1.0);
+            if (XT_DiffSignificant (pRow->base [XT_DIFF_TOTAL], pRow->cur [XT_DIFF_TOTAL], xt_minSeconds))
+            {
+                changed = 1;
+                pRow->regress |= pRow->cur [XT_DIFF_TOTAL] > pRow->base [XT_DIFF_TOTAL];
+            }
+            if (XT_DiffSignificant (pRow->base [XT_DIFF_SELF], pRow->cur [XT_DIFF_SELF], xt_minSeconds))
+            {
+                changed = 1;
+                pRow->regress |= pRow->cur [XT_DIFF_SELF] > pRow->base [XT_DIFF_SELF];
+            }
+            if (changed == 0)
+                continue;
+
+            pRow->impact = fabs (pRow->cur [XT_DIFF_SELF] - pRow->base [XT_DIFF_SELF]);
+            if (fabs (pRow->cur [XT_DIFF_TOTAL] - pRow->base [XT_DIFF_TOTAL]) > pRow->impact)
+                pRow->impact = fabs (pRow->cur [XT_DIFF_TOTAL] - pRow->base [XT_DIFF_TOTAL]);
+            regressions += pRow->regress;
+            nRows++;
+        }
+    }
+
+    qsort (pRows, (size_t) nRows, sizeof (XTDiffRow), XT_DiffCompare);
+
+    printf ("%s: %u changed, %d regressed\n", pTitle, nRows, regressions);
+    if (nRows > 0)
+        printf ("   %-24s %-24s %-20s %s\n", "self", "total", "calls", "name");
+
+    nShown = (xt_maxLines == 0 || nRows < xt_maxLines) ? nRows : xt_maxLines;
+    for (n = 0;  n < nShown;  n++)
+    {
+        pRow = & pRows [n];
+        printf ("%c", (pRow->regress != 0) ? '!' : ' ');
+        XT_DiffPrintChange (pRow->base [XT_DIFF_SELF], pRow->cur [XT_DIFF_SELF]);
+        XT_DiffPrintChange (pRow->base [XT_DIFF_TOTAL], pRow->cur [XT_DIFF_TOTAL]);
+        printf ("  %8.0f -> %-8.0f  %s\n", pRow->base [XT_DIFF_CALLS], pRow->cur [XT_DIFF_CALLS], pRow->pName);
+    }
+    if (nShown < nRows)
+        printf ("   ... %u more\n", nRows - nShown);
+    printf ("\n");
+
+    free (pRows);
+    return (regressions);
+}
+
+
+
+int main (int argc, char *argv[])
+{
+    int         opt, r1, r2;
+    XTProfile   base, cur, baseFuncs, curFuncs;
+
+    while ((opt = getopt (argc, argv, "t:a:n:")) != -1)
+    {
+        switch (opt)
+        {
+            case 't':  xt_minPercent = strtod (optarg, NULL);             break;
+            case 'a':  xt_minSeconds = strtod (optarg, NULL);             break;
+            case 'n':  xt_maxLines   = (unsigned) atoi (optarg);          break;
+            default:
+                fprintf (stderr, "Usage: %s [-t percent] [-a seconds] [-n lines] base.prof new.prof\n", argv[0]);
+                return (2);
+        }
+    }
+    if (argc - optind != 2)
+    {
+        fprintf (stderr, "Usage: %s [-t percent] [-a seconds] [-n lines] base.prof new.prof\n", argv[0]);
+        return (2);
+    }
+
+    memset (& base, 0, sizeof (XTProfile));
+    memset (& cur, 0, sizeof (XTProfile));
+    memset (& baseFuncs, 0, sizeof (XTProfile));
+    memset (& curFuncs, 0, sizeof (XTProfile));
+
+    if (XT_ProfRead (argv [optind], & base) != 0)
+    {
+        fprintf (stderr, "%s: cannot read profile %s\n", argv[0], argv [optind]);
+        return (2);
+    }
+    if (XT_ProfRead (argv [optind + 1], & cur) != 0)
+    {
+        fprintf (stderr, "%s: cannot read profile %s\n", argv[0], argv [optind + 1]);
+        return (2);
+    }
+    if (XT_DiffByName (& base, & baseFuncs) != 0 || XT_DiffByName (& cur, & curFuncs) != 0)
+    {
+        fprintf (stderr, "%s: out of memory\n", argv[0]);
+        return (2);
+    }
+
+    r1 = XT_DiffSection ("Functions", & baseFuncs, & curFuncs);
+    r2 = XT_DiffSection ("Call paths", & base, & cur);
+
+    XT_ProfFree (& base);
+    XT_ProfFree (& cur);
+    XT_ProfFree (& baseFuncs);
+    XT_ProfFree (& curFuncs);
+
+    if (r1 < 0 || r2 < 0)
+        return (2);
+    return ((r1 + r2 > 0) ? 1 : 0);
+}
@@ -0,0 +1,178 @@
+/*
+ * xt-merge.c
+ *  Merge the Execution Trace profiles of many runs into one profile.
+ *  Copyright (C) 2020  Peter Harris   dilbert351@gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ *  Usage:  xt-merge [-j threads] [-o file] run1.prof run2.prof ...
+ *
+ *    -j threads   Number of threads reading files, 0 for one per CPU
+ *                 (default 0).
+ *    -o file      File the merged profile is written to (default stdout).
+ *
+ *  Profiles saved by many runs of a program, such as one per process or one
+ *  per benchmark iteration, are combined by adding the fields of matching call
+ *  paths.  Paths are matched by function name, so differences in the load
+ *  address of each run do not matter, and fields missing from some files are
+ *  taken as zero.  The result is itself a profile, which can be given to
+ *  xt-diff or merged again.
+ *
+ *  The files are split into one group of consecutive files per thread.  Each
+ *  thread reads its group, one line at a time, into a profile of its own, and
+ *  the groups are then merged in order, so memory depends on the number of
+ *  distinct call paths and threads rather than on the number or size of the
+ *  files, and the paths are listed in the same order as if the files had been
+ *  read one after the other.
+ *
+ *  The exit status is 0 on success and 1 if any file could not be read or the
+ *  result could not be written.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L // For getopt() and sysconf()
+
+#include <stdio.h>             // fopen() fclose() fprintf()
+#include <string.h>            // memset()
+#include <stdlib.h>            // calloc() free() atoi()
+#include <unistd.h>            // getopt() sysconf()
+#include <pthread.h>           // pthread_create() pthread_join()
+#include "xtprof.h"
+
+
+typedef struct xtmergegroup_
+{
+    char       **ppFiles;                     /* First file of the group.               */
+    unsigned     nFiles;                      /* Number of files in the group.          */
+    XTProfile    prof;                        /* The group's files merged.              */
+    const char  *pFailed;                     /* File that could not be read (or NULL). */
+    pthread_t    thread;                      /* Thread reading the group.              */
+    int          started;                     /* Set if the thread was started.         */
+}
+XTMergeGroup;
+
+
+
+
+/*-----------------------------------------------------------------------------
+ * Read every file of a group into the group's profile, stopping at the first
+ * file that cannot be read.  Run by one thread per group.
+ */
+
+static void *XT_MergeGroup (void *pArg)
+{
+    XTMergeGroup  *pGroup = (XTMergeGroup *) pArg;
+    unsigned       i;
+
+    for (i = 0;  i < pGroup->nFiles && pGroup->pFailed == NULL;  i++)
+    {
+        if (XT_ProfRead (pGroup->ppFiles [i], & pGroup->prof) != 0)
+            pGroup->pFailed = pGroup->ppFiles [i];
+    }
+    return (NULL);
+}
+
+
+
+int main (int argc, char *argv[])
+{
+    XTMergeGroup  *pGroups;
+    const char    *pOut = NULL;
+    FILE          *fp;
+    unsigned       i, nFiles, nGroups = 0;
+    long           n;
+    int            opt, rtn = 0;
+
+    while ((opt = getopt (argc, argv, "j:o:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'j':  nGroups = (unsigned) atoi (optarg);   break;
+            case 'o':  pOut = optarg;                        break;
+            default:
+                fprintf (stderr, "Usage: %s [-j threads] [-o file] run1.prof run2.prof ...\n", argv[0]);
+                return (1);
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf (stderr, "Usage: %s [-j threads] [-o file] run1.prof run2.prof ...\n", argv[0]);
+        return (1);
+    }
+
+    nFiles = (unsigned) (argc - optind);
+    if (nGroups == 0)
+        nGroups = ((n = sysconf (_SC_NPROCESSORS_ONLN)) > 0) ? (unsigned) n : 1;
+    if (nGroups > nFiles)
+        nGroups = nFiles;
+
+    if ((pGroups = (XTMergeGroup *) calloc (nGroups, sizeof (XTMergeGroup))) == NULL)
+    {
+        fprintf (stderr, "%s: out of memory\n", argv[0]);
+        return (1);
+    }
+
+    /* Group i holds files nFiles * i / nGroups up to nFiles * (i + 1) / nGroups.
+     * The first group is read by this thread, as are any others whose thread
+     * could not be started.
+     */
+    for (i = 0;  i < nGroups;  i++)
+    {
+        pGroups [i].ppFiles = & argv [optind + (int) ((size_t) nFiles * i / nGroups)];
+        pGroups [i].nFiles = (unsigned) ((size_t) nFiles * (i + 1) / nGroups -
+                                         (size_t) nFiles * i / nGroups);
+        if (i > 0 && pthread_create (& pGroups [i].thread, NULL, XT_MergeGroup, & pGroups [i]) == 0)
+            pGroups [i].started = 1;
+    }
+    for (i = 0;  i < nGroups;  i++)
+    {
+        if (pGroups [i].started == 1)
+            pthread_join (pGroups [i].thread, NULL);
+        else
+            XT_MergeGroup (& pGroups [i]);
+    }
+
+    /* Merge each group into the first, releasing it as soon as it is added.
+     */
+    for (i = 0;  i < nGroups;  i++)
+    {
+        if (pGroups [i].pFailed != NULL)
+        {
+            fprintf (stderr, "%s: cannot read profile %s\n", argv[0], pGroups [i].pFailed);
+            rtn = 1;
+        }
+        else if (rtn == 0 && i > 0 && XT_ProfMerge (& pGroups [0].prof, & pGroups [i].prof) != 0)
+        {
+            fprintf (stderr, "%s: out of memory\n", argv[0]);
+            rtn = 1;
+        }
+        if (i > 0)
+            XT_ProfFree (& pGroups [i].prof);
+    }
+
+    if (rtn == 0)
+    {
+        if ((fp = (pOut != NULL) ? fopen (pOut, "w") : stdout) == NULL ||
+            XT_ProfWrite (fp, & pGroups [0].prof) != 0 ||
+            (pOut != NULL && fclose (fp) != 0))
+        {
+            fprintf (stderr, "%s: cannot write profile %s\n", argv[0], (pOut != NULL) ? pOut : "");
+            rtn = 1;
+        }
+    }
+
+    XT_ProfFree (& pGroups [0].prof);
+    free (pGroups);
+    return (rtn);
+}
@@ -61,6 +61,84 @@
 #   define XT_X_AG         0                /* Add gaps - OFF           */
 #endif
 
+#ifdef XT_X_ADAPTIVE
+#   define XT_X_AD         1                /* Adaptive suppression ON  */
+#else
+#   define XT_X_AD         0                /* Adaptive - OFF           */
+#endif
+
+#ifndef XT_X_ADAPT_BUDGET
+#   define XT_X_AB         5.0              /* Overhead budget (%)      */
+#else
+#   define XT_X_AB         (XT_X_ADAPT_BUDGET)
+#endif
+
+#ifdef XT_X_COUNTERS
+#   define XT_X_PC         1                /* Perf counters ON         */
+#else
+#   define XT_X_PC         0                /* Perf counters - OFF      */
+#endif
+
+#ifdef XT_X_ALLOCS
+#   define XT_X_AL         1                /* Allocation tracking ON   */
+#else
+#   define XT_X_AL         0                /* Allocations - OFF        */
+#endif
+
+#ifndef XT_X_FLUSH
+#   define XT_X_FD         0                /* Incremental flush - OFF  */
+#else
+#   define XT_X_FD         (XT_X_FLUSH)     /* Flush subtrees at depth  */
+#endif
+
+#ifndef XT_X_PRUNE
+#   define XT_X_PR         0.0              /* Pruning - OFF            */
+#else
+#   define XT_X_PR         (XT_X_PRUNE)     /* Shortest call kept (uS)  */
+#endif
+
+#ifndef XT_X_SPILL
+#   define XT_X_SB         0.0              /* No memory budget         */
+#else
+#   define XT_X_SB         (XT_X_SPILL)     /* Tree memory budget (MB)  */
+#endif
+
+#ifndef XT_X_HOT_PATHS
+#   define XT_X_HP         0                /* Hot path report - OFF    */
+#else
+#   define XT_X_HP         (XT_X_HOT_PATHS) /* Hot paths listed         */
+#endif
+
+#ifndef XT_X_SAMPLE
+#   define XT_X_SR         0                /* Sampling - OFF           */
+#else
+#   define XT_X_SR         (XT_X_SAMPLE)    /* Samples per CPU second   */
+#endif
+
+#ifdef XT_X_ELIDE
+#   define XT_X_EL         1                /* Elide template args ON   */
+#else
+#   define XT_X_EL         0                /* Template args - shown    */
+#endif
+
+#ifndef XT_X_THREADS
+#   define XT_X_TH         1                /* Print on one thread      */
+#else
+#   define XT_X_TH         (XT_X_THREADS)   /* Print threads (0 = CPUs) */
+#endif
+
+#if defined (XT_X_CONTROL) && !defined (XT_X_SHARED)
+#   define XT_X_CT         1                /* Control socket ON        */
+#else
+#   define XT_X_CT         0                /* Control socket - OFF     */
+#endif
+
+#ifdef XT_X_PROFILE
+#   define XT_X_PF         XT_X_PROFILE     /* Profile file name        */
+#else
+#   define XT_X_PF         NULL             /* No profile saved         */
+#endif
+
 #ifndef XT_X_TIMER
 #   define XT_X_T         XT_TIMER_DISABLED
 #else
@@ -68,6 +146,8 @@
 #      define XT_X_T      XT_TIMER_CPU
 #   elif XT_X_TIMER == 2
 #      define XT_X_T      XT_TIMER_ELAPSED
+#   elif XT_X_TIMER == 3
+#      define XT_X_T      XT_TIMER_BOTH
 #   endif
 #endif
 
@@ -76,6 +156,8 @@
 /*               - - - -  USER DEFINED GLOBAL VARIABLES  - - - -                        */
 
 /* Control variables set by user.  Set values as required before compiling.
+ * In the shared library (libxt.so) they are read from the environment when the
+ * program starts instead (see XT_Configure()).
  */
 
 /* Set this value to 1 to enable funtion call tracing and 0 to disable it.
@@ -123,7 +205,12 @@
  * time spent inside a function (including the time taken by each sub function
  * it calls).  In real time mode the time reported is the total program
  * execution time from the start of the program up to when the function is
- * called.  To disable time reporting, set the value to 0.
+ * called.  To disable time reporting, set the value to 0.  When set to
+ * XT_TIMER_BOTH, the clock time of each call is reported along with the CPU
+ * time used by the thread making it (CLOCK_THREAD_CPUTIME_ID) and the
+ * difference, the time it spent off the CPU, blocked on I/O, a lock or a
+ * sleep, so waiting can be told apart from computing.  In real time mode this
+ * is the same as clock time.
  */
     XTTimer          xt_timer         = XT_X_T;
 
@@ -150,6 +237,144 @@
  */
     const char      *xt_pOutputFile   = NULL;
 
+/* Normally the tree is printed when main() exits, which never happens in
+ * programs such as daemons, and memory grows with every call.  Setting this
+ * value to a depth N (1 or more) prints each completed subtree whose root is at
+ * depth N or less (main() is at depth 0) as soon as it is known whether the
+ * root is the last child of its parent (i.e. when its next sibling is called
+ * or its parent returns), and then frees its nodes.  Memory is then only used
+ * for the functions currently running plus one subtree.  With N = 1 the output
+ * is the same as the normal tree except that main() is printed without times.
+ * With larger values, functions above depth N are printed (without times) as
+ * soon as their first subtree is.  As whether they have later siblings is not
+ * known until they return, the lines printed below them are held in memory
+ * until then (up to XT_HOLD_MAX bytes, beyond which they are drawn as if they
+ * do, and a warning is given).
+ * The profile is not saved in this mode.
+ */
+    int              xt_flushDepth    = XT_X_FD;
+
+/* This is either a NULL or the name of a file where an aggregated profile is
+ * saved when main() exits (non real time mode only).  The profile has one line
+ * per unique call path giving the number of calls, the total time and the time
+ * spent in the function itself.  It is read by the xt-diff tool.
+ */
+    const char      *xt_pProfileFile  = XT_X_PF;
+
+/* Setting this value to 1 reads performance counters (Linux perf_event_open())
+ * as each function is entered and exited, in non real time mode.  The number
+ * of instructions, cycles, cache misses and branch misses used by each call is
+ * printed (as instructions per cycle and misses) after the function name and
+ * saved in the profile.  Where no hardware counters are available, e.g. in
+ * many containers and virtual machines, the page faults and context switches
+ * are counted instead.  If no counters can be opened at all, a warning is
+ * printed and the option is ignored.
+ */
+    static int       xt_counters      = XT_X_PC;
+
+/* This value is 1 when heap allocations are attributed to functions (non real
+ * time mode only).  Every malloc(), calloc(), realloc() and free() made by the
+ * program is charged to the function running at the time, and the bytes and
+ * number of allocations are printed after the function name, both including
+ * and excluding the functions it calls.  This needs the program to be linked
+ * with the wrappers below, so it can only be set with ALLOCS=1 in the make file.
+ */
+    static int       xt_allocs        = XT_X_AL;
+
+/* Setting this value to 1 enables adaptive suppression of hot tiny functions.
+ * The hooks count the calls made to each function address, and once a function
+ * is called so often and returns so quickly that its hooks alone would cost
+ * more than xt_adaptBudget percent of the run time, it is suppressed.  From
+ * then on its calls cost only a table lookup and a flag check, no node is
+ * stored for it and its time simply becomes part of its parent's own time.
+ * Functions suppressed are listed with their call counts after the tree.
+ */
+    static int       xt_adaptive      = XT_X_AD;
+
+/* The overhead budget used by adaptive mode, as a percentage.  The thresholds
+ * for both call rate and average duration are derived from this value and the
+ * measured cost of the hooks, so there should be no need to change it.
+ */
+    double           xt_adaptBudget   = XT_X_AB;
+
+/* Setting this value to a time in microseconds removes every call shorter than
+ * it that made no (recorded) calls itself as soon as it returns, so memory and
+ * print time depend only on the calls long enough to be of interest.  Its
+ * node is simply dropped from the end of the tree, and the call is counted,
+ * with its time, against its parent, after which the parent's pruned calls
+ * are printed (and saved in the profile).  A parent whose children have all
+ * been pruned can itself be pruned in turn.  The timer must be enabled.
+ */
+    double           xt_pruneTime     = XT_X_PR;
+
+/* C++ function names are demangled (e.g. _ZN2ns3fooEi becomes ns::foo(int))
+ * when the program is linked with the C++ runtime, i.e. with g++.  Each name is
+ * only demangled once, when the tree is printed, never while it is recorded.
+ * Setting this value to 1 also replaces template arguments with <>, so that
+ * std::vector<int, std::allocator<int> >::push_back(int const&) is printed as
+ * std::vector<>::push_back(int const&), which keeps lines short.
+ */
+    int              xt_elideTemplates = XT_X_EL;
+
+/* This value is 1 when a running program can be inspected with the xt-ctl
+ * tool.  A background thread serves the Unix domain socket /tmp/xt-<pid>.sock
+ * and answers requests for the functions each thread is running, the functions
+ * with the most self time so far, the memory used by the library and the
+ * number of events it could not record.  Each thread keeps a shadow stack of
+ * the functions it is running, which the hooks update without any locking, and
+ * the answers are built from snapshots of these.  The thread needs the program
+ * to be linked with -pthread, so it can only be set with CONTROL=1 in the make
+ * file.
+ */
+    static int       xt_control       = XT_X_CT;
+
+/* The number of threads used to print a large call tree when main() exits,
+ * where 0 means one per CPU.  The tree is split into ranges of complete
+ * subtrees which are printed at the same time, each into its own buffer, and
+ * the buffers are then written out in order, so the output is the same as
+ * when it is printed by a single thread.  Small trees, and the subtrees
+ * printed by incremental flushing, are always printed by the calling thread.
+ * The threads need the program to be linked with -pthread, so this can only
+ * be changed from 1 with THREADS=N in the make file.
+ */
+    int              xt_printThreads  = XT_X_TH;
+
+/* The memory budget for the call tree in MB, or 0 for none.  Once keeping the
+ * whole tree in memory would take more than this, the oldest part of it is
+ * compressed by a background thread and written to a temporary file instead,
+ * from which it is read back when the tree is printed, so the output is the
+ * same as when it is kept in memory.  Only the checkpoints, and the counter,
+ * CPU time, allocation and pruning arrays when these are used, stay in memory
+ * for every node.  Nothing is spilled when flushing (xt_flushDepth), as the
+ * tree is then printed as it goes.  The thread needs the program to be linked
+ * with -pthread, so this can only be set with SPILL=<MB> in the make file.
+ */
+    double           xt_spillBudget   = XT_X_SB;
+
+/* When this value is N (1 or more), a report of where the time went follows
+ * the tree: the N call paths taking the most time, from main() down to a
+ * function that calls nothing else, with each function's share of the time of
+ * its caller, and the critical path, the chain of the longest call made at
+ * each level, with each call's self time.  It needs the timer, and is not
+ * produced when flushing.
+ */
+    unsigned         xt_hotPaths      = XT_X_HP;
+
+/* When this value is N (1 or more), calls are sampled rather than recorded.
+ * The hooks only push and pop the function on the shadow stack of the thread,
+ * taking no time and allocating no memory, and a profiling timer (SIGPROF)
+ * interrupts the program N times for each second of CPU time it uses.  Each
+ * time, the stack of the thread that was running is added to a tree of the
+ * call paths seen.  When main() returns, this tree is printed as the call
+ * tree, and used for the hot paths and the profile, with the CPU time each
+ * function's samples stand for in place of its time.  Calls shorter than a
+ * sample period may not be seen at all.  Counters, allocations, flushing and
+ * adaptive mode are not available.  As with any profiler using SIGPROF, a
+ * system call may return early with EINTR.  This can only be set with
+ * SAMPLE=N in the make file.
+ */
+    unsigned         xt_sampleRate    = XT_X_SR;
+
 
 
 
@@ -166,6 +391,8 @@
  */
     unsigned         xt_level         = 0;    /* Trace stack level count.               */
     unsigned         xt_prevLvl       = 0;    /* Previous stack level.                  */
+    XTSpan           xt_spans [XT_SPAN_MAX]; /* Spans open, innermost last.            */
+    unsigned         xt_nSpans        = 0;    /* Number of spans in xt_spans.          */
     unsigned         xt_maxLvl        = 0;    /* Maximum stack level.                   */
     int              xt_lineNo;               /* Stores current line number (_ macro).  */
     double           xt_realTimeStart;        /* The start time of real time tracing.   */
@@ -174,18 +401,96 @@
     char             xt_LHoriz[65];           /* UTF-8 char buffer for 'L' + hor line.  */
     char             xt_SHoriz[65];           /* UTF-8 char buffer for 'S' line.        */
     char             xt_space[65];            /* Just blank spaces.                     */
+    double           xt_hookCost;             /* Measured cost of recording one call.   */
+    clockid_t        xt_clockId = CLOCK_MONOTONIC; /* Clock read by XT_GetTicks().      */
 
-/* Each function call (tree node) is defined by a XTBranch structure.  A new
- * node is created each time the __cyg_profile_func_enter() function is called.
- * Nodes are stored as a single large dynamically allocated array.  The array
- * will automatically expand as required.  The pointer xt_pTree points to the
- * first entry of the array, while xt_treeSize represents the total number of
- * nodes currently available.  The variable xt_nextBranch is the index of the
- * next available entry in the array.
+/* The paths taken by the hooks for every call.  They are chosen by the first
+ * call, once the options are known (see XT_SelectHooks()).
+ */
+    XTHook           xt_pEnter        = XT_EnterFirst;
+    XTHook           xt_pExit         = XT_ExitAny;
+
+/* The state kept while printing the tree.  xt_pBars has an entry for each level
+ * of the tree set to 1 if the node last printed at that level has later
+ * siblings, in which case a vertical line is drawn in that column for the
+ * nodes below it.  Because it is kept between calls, a tree can be printed in
+ * several batches (see xt_flushDepth).  xt_pLine is the line buffer, sized to
+ * hold the prefix for the deepest level.  Each print thread has its own copy
+ * of these, and of xt_pOut, where its output goes (xt_fp when NULL).  When
+ * flushing, xt_pending is the index of the completed subtree waiting to be
+ * printed (or XT_NO_PARENT) and xt_printedAt[] holds, for each level above the
+ * flush depth, 1 + the index of the running function at that level if it has
+ * already been printed.
  */
-    XTBranch        *xt_pTree         = NULL;   /* Array of XTBranch type objects.      */
-    unsigned         xt_treeSize;               /* Number of objects in array.          */
+    _Thread_local unsigned char *xt_pBars = NULL; /* Vertical line needed per level.    */
+    _Thread_local char *xt_pLine      = NULL;   /* Print line buffer.                   */
+    _Thread_local unsigned xt_printLevels;      /* Levels xt_pBars and xt_pLine hold.   */
+    _Thread_local FILE *xt_pOut       = NULL;   /* Output of a print thread.            */
+    unsigned         xt_pending       = XT_NO_PARENT; /* Subtree waiting to be flushed. */
+    unsigned         xt_printedAt [XT_FLUSH_MAX];     /* Running functions printed (+1).*/
+
+/* Until it is known whether a running function printed when flushing has later
+ * siblings, its line and the lines printed below it are held in xt_pHold, with
+ * marks in place of the pieces that depend on it (see XT_HoldResolve()).  For
+ * each level, xt_holdAt[] holds 1 + the offset of the line of such a function,
+ * and xt_holdClosed[] is set once it has returned.  xt_holdGuessed is set once
+ * a running function has had to be drawn before this was known.
+ */
+    char            *xt_pHold         = NULL;   /* Flushed lines held back.             */
+    size_t           xt_holdLen       = 0;      /* Bytes held.                          */
+    size_t           xt_holdAt [XT_FLUSH_MAX];  /* Held line at each level (+1).        */
+    unsigned char    xt_holdClosed [XT_FLUSH_MAX]; /* Returned, siblings not yet known. */
+    int              xt_holdGuessed   = 0;      /* Drawn before siblings known.         */
+
+/* Each function call (tree node) is recorded in a compact form taking only a
+ * few bytes, so very long runs can be traced.  The level of each node is kept
+ * in the array xt_pLevel (16 bits, so levels deeper than XT_LEVEL_MAX are not
+ * recorded), and xt_levelsSize is the number of nodes it can hold.
+ * xt_nextBranch is the index of the next node.  Everything else goes into the
+ * byte stream xt_pData, one record per event in the order the events happen:
+ *     enter:  <name id> [<ticks>]
+ *     exit:   [<ticks>]
+ * Each value is a varint (7 bits per byte, low bits first, the top bit set on
+ * all but the last byte).  Ticks are nanoseconds since the previous event, and
+ * are only present when timing (xt_timer).  The kind of each record is implied
+ * by the levels: between node i and node i + 1 there are exactly
+ * level[i] - level[i + 1] + 1 exits.  In the same way, the parent and last
+ * child of a node are never stored, as they follow from the levels as well.
+ * A typical call takes 5 to 8 bytes.
+ *
+ * Nodes cannot be found in the stream directly, so xt_pCheck holds the offset
+ * of every XT_CHECK_NODES'th node and the time of the event before it, from
+ * which any node can be reached by decoding at most XT_CHECK_NODES nodes.
+ * Line numbers are rare, so they are kept in xt_pLines sorted by node index.
+ * The functions still running are held in xt_pOpen, one entry per level,
+ * which gives the parent of a new node and the point to wind the stream back
+ * to when the most recent nodes are discarded.
+ *
+ * When the tree grows past the memory budget (xt_spillBudget), the oldest half
+ * of the stream or of the levels is spilled to disk (see XT_Spill()) instead of
+ * the array being doubled.  xt_pData then holds the stream from offset
+ * xt_dataBase on and xt_pLevel the levels from node xt_levelBase on.  Offsets
+ * and node indexes are never changed by this, and the tree is always read
+ * through XT_GetVar(), XT_BackVar() and XT_Level(), which fetch spilled bytes
+ * as needed.  xt_treeSize is the number of nodes the checkpoint array, and the
+ * other arrays kept for every node, can hold.
+ */
+    uint16_t        *xt_pLevel        = NULL;   /* Level of each node.                  */
+    unsigned         xt_levelsSize;             /* Number of nodes in xt_pLevel.        */
+    unsigned         xt_levelBase;              /* Index of the node xt_pLevel starts.  */
+    unsigned         xt_treeSize;               /* Number of nodes in xt_pCheck etc.    */
     unsigned         xt_nextBranch;             /* Index of next abailable array item.  */
+    unsigned char   *xt_pData         = NULL;   /* Stream of enter and exit records.    */
+    size_t           xt_dataSize;               /* Bytes allocated for the stream.      */
+    size_t           xt_dataUsed;               /* Bytes of the stream in use.          */
+    size_t           xt_dataBase;               /* Stream offset xt_pData starts at.    */
+    unsigned long long xt_lastTick;             /* Time of the last event recorded.     */
+    XTCheck         *xt_pCheck        = NULL;   /* Checkpoint of every 256th node.      */
+    XTLine          *xt_pLines        = NULL;   /* Nodes with line numbers.             */
+    unsigned         xt_nLines;                 /* Entries used in xt_pLines.           */
+    unsigned         xt_linesSize;              /* Entries allocated in xt_pLines.      */
+    XTOpen          *xt_pOpen         = NULL;   /* Running node at each level.          */
+    unsigned         xt_openSize;               /* Levels allocated in xt_pOpen.        */
 
     unsigned         xt_exitNodeIndex;          /* Node where exit timer is to be set.  */
 
@@ -203,6 +508,21 @@
     unsigned         xt_nameBuffSize;           /* Number of characters in buffer.      */
     unsigned         xt_nextAvail;              /* Index of next abailable entry.       */
 
+/* Each name is only stored once and is given a small id, the order in which
+ * it was first seen, which is what the tree records.  xt_pNameAt gives the
+ * index of each name in the buffer.  Names already in the buffer are found
+ * using the hash table xt_pNameHash, an open addressing table holding the
+ * (id + 1) of each name, which is doubled in size whenever it becomes half
+ * full.  The name printed for each id, which differs for demangled C++ names,
+ * is given by xt_pShowAt (see XT_Demangle()).
+ */
+    unsigned        *xt_pNameHash     = NULL;   /* Hash table of name ids (+1).         */
+    unsigned         xt_nameHashSize;           /* Number of entries (power of 2).      */
+    unsigned         xt_nNames;                 /* Number of names stored.              */
+    unsigned        *xt_pNameAt       = NULL;   /* Index of each name in the buffer.    */
+    unsigned        *xt_pShowAt       = NULL;   /* Index of each name as printed.       */
+    unsigned         xt_nShown;                 /* Names with an entry in xt_pShowAt.   */
+
 /* This is just the pointer to the file stream used by the trace facility.  It
  * is initialised by the first call to __cyg_profile_func_enter() and is either
  * a pointer to a file stream or the standard error path.  Must initially be
@@ -210,6 +530,100 @@
  */
     FILE            *xt_fp            = NULL;
 
+/* When performance counters are enabled, the counter values for each node are
+ * kept in the array xt_pCounts which runs in parallel with xt_pLevel (so nodes
+ * do not grow when counters are not used).  Each node has xt_nCounters values
+ * holding the counts on entry, replaced by the counts used on exit.  The file
+ * descriptors and, where user space reads (rdpmc) are allowed, the mapped
+ * control pages of the counters are kept in the following arrays.
+ */
+    unsigned long long *xt_pCounts    = NULL;   /* Counter values of each node.         */
+    unsigned         xt_countsSize;             /* Number of nodes in counter array.    */
+    unsigned         xt_nCounters;              /* Number of counters opened.           */
+    int              xt_cntFd [XT_COUNTERS];    /* Counter file descriptors.            */
+    void            *xt_cntPage [XT_COUNTERS];  /* Mapped perf_event_mmap_page or NULL. */
+    const XTEvent   *xt_pEvents;                /* Descriptions of the open counters.   */
+
+#ifdef __linux__
+    static const XTEvent  xt_hwEvents [] =      /* Preferred hardware counters.         */
+    {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles",           "cycles"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions",     "instr"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache_misses",     "cache misses"},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch_misses",    "branch misses"}
+    };
+    static const XTEvent  xt_swEvents [] =      /* Used when there is no hardware PMU.  */
+    {
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page_faults",      "page faults"},
+        {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "context_switches", "context switches"}
+    };
+#endif
+
+/* When timing with XT_TIMER_BOTH, the thread CPU time of each node is kept in
+ * xt_pCpu, parallel to xt_pLevel, holding the time on entry which is replaced
+ * by the time used by the call on exit.
+ */
+    unsigned long long *xt_pCpu       = NULL;   /* Thread CPU time of each node (nS).   */
+    unsigned         xt_cpuSize;                /* Number of nodes in CPU time array.   */
+
+/* Heap allocations charged directly to each node (its self values) are kept
+ * in xt_pAllocs, another array parallel to xt_pLevel.  Totals including called
+ * functions are worked out when they are printed.
+ */
+    XTAlloc         *xt_pAllocs       = NULL;   /* Allocations made by each node.       */
+    unsigned         xt_allocsSize;             /* Number of nodes in allocation array. */
+
+/* When short calls are pruned (xt_pruneTime), the calls and time pruned from
+ * the children of each node are kept in xt_pPruned, parallel to xt_pLevel.
+ */
+    XTPrune         *xt_pPruned       = NULL;   /* Calls pruned below each node.        */
+    unsigned         xt_prunedSize;             /* Number of nodes in pruned array.     */
+    unsigned long long xt_pruneTicks  = 0;      /* xt_pruneTime in nS (0 if not used).  */
+
+/* The function table holds the per address counters used by the adaptive mode
+ * and the control socket.  It is a fixed size open addressing hash table keyed
+ * by the function address, so entries never move and no memory is allocated
+ * in the hooks.  It is only allocated when one of these is used, and is never
+ * freed as the control thread may read it at any time.  If the table ever
+ * fills, the extra functions are simply traced normally.
+ */
+    XTFunc          *xt_pFuncTable    = NULL;   /* XT_FUNC_TABLE entries or NULL.       */
+
+/* Every thread has its own shadow stack, found through xt_pStack, which is
+ * created the first time the thread calls a function.  Stacks are never freed
+ * and are linked into the list xt_pStacks (a new stack is added at the head
+ * with an atomic exchange) so that the control thread can read them all.  The
+ * events that could not be recorded are counted in the xt_drop... variables.
+ */
+    static _Thread_local XTStack *xt_pStack = NULL; /* This thread's shadow stack.  */
+    XTStack         *xt_pStacks       = NULL;   /* List of every thread's stack.        */
+    unsigned long long xt_dropFrames  = 0;      /* Calls deeper than XT_STACK_MAX.      */
+    unsigned long long xt_dropFuncs   = 0;      /* Calls missing from the func table.   */
+    unsigned long long xt_dropNodes   = 0;      /* Calls deeper than XT_LEVEL_MAX.      */
+#ifdef XT_X_SPILL
+    size_t           xt_spillBytes    = 0;      /* xt_spillBudget in bytes (0 if off).  */
+    XTSpiller        xt_spiller;                /* Spill thread and its queue.          */
+    XTSpill          xt_dataSpill     = {NULL, 0, 0, 0};  /* Spilled stream blocks.     */
+    XTSpill          xt_levelSpill    = {NULL, 0, 0, XT_SPILL_CACHE};  /* and levels.   */
+    _Thread_local XTCached xt_spillCache [2 * XT_SPILL_CACHE]; /* Blocks read back.     */
+    _Thread_local unsigned char *xt_pUnpack = NULL; /* Compressed block being read.     */
+#endif
+#ifdef XT_X_SAMPLE
+    XTSample        *xt_pSamples      = NULL;   /* Tree of the call paths sampled.      */
+    unsigned         xt_nSamples      = 0;      /* Nodes used in xt_pSamples.           */
+    XTStack         *xt_pSampleStack  = NULL;   /* Shadow stack of main()'s thread.     */
+    unsigned long long xt_samplePeriod = 0;     /* CPU time of one sample (nS).         */
+    unsigned long long xt_sampleTicks = 0;      /* Clock while the tree is built.       */
+    unsigned long long xt_dropSamples = 0;      /* Samples not added to xt_pSamples.    */
+    char             xt_sampleLock    = 0;      /* Held while xt_pSamples is changed.   */
+#endif
+#ifdef XT_X_CONTROL
+    int              xt_ctlFd         = -1;     /* Listening control socket.            */
+    char             xt_ctlPath [64];           /* Name of the control socket.          */
+    unsigned        *xt_pCtlTop       = NULL;   /* Functions sorted by XT_ControlTop(). */
+    unsigned long long *xt_pCtlSelf   = NULL;   /* Self time of each table entry (nS).  */
+#endif
+
 
 
 
@@ -225,52 +639,19 @@
  * compiler not to insert the hook into these functions.  If this was not
  * done, the hook would be recursively called until the stack exploded and
  * a segmentation fault was generated.
+ * The work is done by the enter path xt_pEnter, which is XT_EnterFirst() until
+ * the first call has chosen the path for the options in use (see
+ * XT_SelectHooks()), so the options are not tested again for every call.
  */
 
 __attribute__ ((no_instrument_function))
 void __cyg_profile_func_enter (void *this_fn, void *call_site)
 {
-    Dl_info      info;                  /* Used to get function names.      */
-    char         thisName[65];
-
     /* Tell the compiler not to worry about this unused argument.
      */
     UNUSED (call_site);
 
-    if (xt_enabled == 1)
-    {
-        /* This section is called only once.  It is used to initialise the
-         * output path.  If a file name has been specified, it is opened.
-         * If no file name was specified, the standard error path is used.
-         * If initialisation failed, an error is generated and execution
-         * tracing is disabled.
-         */
-        if (xt_fp == NULL)                 /* If NULL, not initialised.     */
-        {
-            if (xt_pOutputFile != NULL)    /* File name specified.          */
-            {
-                if ((xt_fp = fopen (xt_pOutputFile, "w")) != NULL)
-                {
-                    xt_enabled = 0;
-                    fprintf (stderr, "Could not open trace path.  Tracing disabled!\n");
-                    return;
-                }
-            }
-            else
-                xt_fp = stderr;         /* No file name, so use std error.  */
-        }
-
-        /* Retreive information about the symbol for this_fn addr.  Addresses
-         * may be particularly useful for debugging with GDB, but they are
-         * very uninformative to read.  what we want is the actual function
-         * name.
-         */
-        if (dladdr (this_fn, & info) != 0)
-        {
-            strncpy (thisName, (info.dli_sname != NULL) ? info.dli_sname : "???", 64);
-            XT_Trace (thisName);
-        }
-    }
+    xt_pEnter (this_fn);
 }
 
 
@@ -278,580 +659,4887 @@ void __cyg_profile_func_enter (void *this_fn, void *call_site)
 /*-----------------------------------------------------------------------------
  * This function is the hook inserted immediately before the return of every
  * C function by the GCC compiler when the -finstrument_function command
- * line option is used.
+ * line option is used.  The work is done by the exit path xt_pExit.
  */
 
 __attribute__ ((no_instrument_function))
 void __cyg_profile_func_exit  (void *this_fn, void *call_site)
 {
-    unsigned   i;
-    char      *pOut, lineBuff[512];
-    XTBranch  *pBranch;
-
-    /* Tell the compiler not to worry about these unused arguments.
+    /* Tell the compiler not to worry about this unused argument.
      */
-    UNUSED (this_fn);
     UNUSED (call_site);
 
-    if (xt_enabled == 1)
-    {
-        xt_prevLvl = xt_level;
-        xt_level--;
+    xt_pExit (this_fn);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The enter path used by the first call, normally main().  It is used to
+ * initialise the output path.  If a file name has been specified, it is opened.
+ * If no file name was specified, the standard error path is used.  If
+ * initialisation failed, an error is generated and execution tracing is
+ * disabled.  Otherwise the options are checked, the paths used for every later
+ * call are chosen and the call is passed on to the enter path chosen.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_EnterFirst (void *this_fn)
+{
+    if (xt_enabled != 1)
+        return;
 
-        if (xt_realTime == 1)
+    if (xt_fp == NULL)                     /* If NULL, not initialised.     */
+    {
+#ifdef XT_X_SHARED
+        XT_Configure ();
+#endif
+        if (xt_pOutputFile != NULL)        /* File name specified.          */
         {
-            if (xt_traceLines == 1)
+            if ((xt_fp = fopen (xt_pOutputFile, "w")) == NULL)
             {
-                pOut = lineBuff;
-                if (xt_prevLvl > 1)
-                {
-                    for (i = XT_INDENT * (xt_level - 1); i > 0;  i--)
-                        *pOut++ = ' ';
-                }
-                if (xt_prevLvl > 0)            /* Don't output for main()   */
-                {
-                    strcpy (pOut, xt_SHoriz);
-                    XT_OUT ("%s\n", lineBuff);
-                }
+                XT_Disable ();
+                fprintf (stderr, "Could not open trace path.  Tracing disabled!\n");
+                return;
             }
-            else
-                if (xt_level > 0 && (xt_maxLvl - xt_level) >= 2)
-                {
-                    XT_OUT ("\n");
-                    xt_maxLvl = xt_level;
-                }
-//                XT_OUT ("\n");
         }
         else
+            xt_fp = stderr;             /* No file name, so use std error.  */
+
+#ifdef XT_X_SAMPLE
+        if (xt_sampleRate > 0 && xt_realTime == 1)
+        {
+            xt_sampleRate = 0;
+            fprintf (stderr, "Sampling is not possible in real time mode.  Sampling disabled!\n");
+        }
+        if (xt_sampleRate > 0 && XT_SampleInit () != 0)
         {
-           /* First store the current clock ticks as the exit time for this
-            * node, then set the next exit node as this nodes parent.
-            */
-            pBranch = & xt_pTree [xt_exitNodeIndex];
-            pBranch->exitTime = XT_GetTime ();
-            xt_exitNodeIndex = pBranch->parent;
+            xt_sampleRate = 0;
+            fprintf (stderr, "Could not start the sampling timer.  Sampling disabled!\n");
+        }
+#endif
 
-            if (xt_lineNo != 0)
-                pBranch->lineNo = xt_lineNo;
+        xt_clockId = (xt_timer == XT_TIMER_CPU) ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_MONOTONIC;
 
-            /* Only need to tidy up if we are not in real time mode.
-             */
-            if (xt_level == 0)
-            {
-                /* Exiting at level 0 means we are exiting main(), so generate
-                 * output and clean up after ourselves.
-                 */
-                XT_Print ();
-                XT_Cleanup ();
-            }
+        if ((xt_adaptive == 1 || xt_control == 1) &&
+            (xt_pFuncTable = (XTFunc *) XT_CALLOC (XT_FUNC_TABLE, sizeof (XTFunc))) == NULL)
+        {
+            xt_adaptive = 0;
+            xt_control = 0;
+            fprintf (stderr, "Not enough memory for the function table.  Adaptive mode and control disabled!\n");
         }
-        xt_lineNo = 0;                         /* Reset for next function.  */
-
-        if (xt_level == 0 && xt_pOutputFile != NULL)
-            fclose (xt_fp);
-    }
-}
 
+        if (xt_adaptive == 1)
+            XT_AdaptInit (this_fn);
 
+        if (xt_flushDepth >= XT_FLUSH_MAX)
+            xt_flushDepth = XT_FLUSH_MAX - 1;
 
-/*-----------------------------------------------------------------------------
- * This function is called at the beginning of each function in the program and
- * it operates in one of two ways.  In normal mode, function calls are stored
- * in memory and when the main() function is about to exit.  In this way, the
- * call tree can be printed as a pretty structure.
- * In real time mode, the indented function name is printed immediately.  This
- * is particularly useful if the program terminates unexpectedly (e.g. such as
- * when a segmentation fault occurs).  Under these circumstances, it is not
- * possible to get the pretty print version of the call tree that happens at
- * the end of the program.
- */
+        if (xt_pruneTime > 0.0 && xt_realTime == 0)
+        {
+            if (xt_timer != XT_TIMER_DISABLED)
+                xt_pruneTicks = (unsigned long long) (xt_pruneTime * 1000.0);
+            else
+                fprintf (stderr, "Pruning needs the timer.  Pruning disabled!\n");
+        }
 
-__attribute__ ((no_instrument_function))
-void XT_Trace (const char *func)
-{
-    unsigned  i;
-    char     *pOut;
-    char      lineBuff [512];                  /* Print line buffer.         */
+        if (xt_hotPaths > 0 && xt_realTime == 0 && xt_timer == XT_TIMER_DISABLED)
+        {
+            xt_hotPaths = 0;
+            fprintf (stderr, "Hot paths need the timer.  Report disabled!\n");
+        }
 
-    if (xt_realTime == 1)                      /*   --- REAL TIME MODE ---   */
-    {
-        /* If asked to print times in real time mode, get the start time of
-         * the program if we are just entered the main() function.
-         */
-        if (xt_timer != XT_TIMER_DISABLED && xt_level == 0)
-            xt_realTimeStart = XT_GetTime ();
-
-        /* In real time mode, just output the results immediately.  This is
-         * useful in situations such as segmentation faults where the normal
-         * mode would crash the entire program before getting a chance to
-         * output the call trace tree.  In real time mode, the output is
-         * generated on the run and is available when the seg fault occurs.
-         */
-        XT_PrintInit ();
+#ifdef XT_X_SPILL
+        if (xt_spillBudget > 0.0 && xt_realTime == 0 && xt_flushDepth == 0)
+            xt_spillBytes = (size_t) (xt_spillBudget * 1048576.0);
+#endif
 
-        lineBuff[0] = '\0';
-        pOut = lineBuff;
-        if (xt_traceLines == 1)
+        if (xt_counters == 1 && XT_CountersInit () != 0)
         {
-            if (xt_level >= 1)
-            {
-                for (i = XT_INDENT * (xt_level - 1); i > 0;  i--)
-                    *pOut++ = ' ';
-                strcpy (pOut, xt_LHoriz);
-            }
+            xt_counters = 0;
+            fprintf (stderr, "Could not open performance counters.  Counters disabled!\n");
         }
-        else
+
+#ifdef XT_X_CONTROL
+        if (xt_control == 1 && XT_ControlInit () != 0)
         {
-            for (i = XT_INDENT * xt_level; i > 0;  i--)
-                *pOut++ = ' ';
-            *pOut = '\0';
+            xt_control = 0;
+            fprintf (stderr, "Could not open control socket.  Control disabled!\n");
         }
-        XT_OUT ("%s%s", lineBuff, func);
-
-        if (xt_timer != XT_TIMER_DISABLED)
-            XT_PrintElapsedTime (xt_realTimeStart, XT_GetTime ());
+#endif
 
-        XT_OUT ("\n");
-    }
-    else                                       /*    --- NORMAL MODE ---     */
-    {
-        /* The normal mode.  In this mode we want to generate a pretty tree
-         * structure, but we can't know how to draw some nodes before exiting
-         * a function (which may not happen for some lines later).  To overcome
-         * this issue, all the call tree is stored and printed out at the end
-         * of the program.  The problem with this is that problems such as a
-         * segmentation fault which cause the program to prematurely finish
-         * prevent the call tree from being generated.
-         */
-        XT_AddBranch (func, xt_level);
+        XT_SelectHooks ();
     }
 
-    if (xt_level++ > 1)                         /* Incr stack level.          */
-        xt_prevLvl++;                           /* Incr ptrev stack level.    */
-    if (xt_level > xt_maxLvl)
-        xt_maxLvl = xt_level;
+    xt_pEnter (this_fn);
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * This function performs all the pretty printing for the function call tree in
- * non-realtime mode.  In this mode, the data is stored in a tree structure
- * xt_pTree[] of size xt_treeSize.
- * In realtime mode, printing is done immediately in the XT_Trace() function.
+ * The general enter path, used with any options.
  */
 
 __attribute__ ((no_instrument_function))
-void XT_Print (void)
+void XT_EnterAny (void *this_fn)
 {
-    int        endOfBlock;
-    unsigned   n, idx, idxp, index, level, parentIdx, node [64];
-    char      *p1, *p2;
-    char       lineBuff1 [128];          /* Print line buffer.                */
-    char       lineBuff2 [128];
-    char       lineNoBuff [16];
-    XTBranch  *pBranch;
-
-    XT_PrintInit ();                     /* Initialise elements for printing  */
+    Dl_info      info;                  /* Used to get function names.      */
+    XTFunc      *pFunc;
 
-    for (index = 0;  index < xt_nextBranch;  index++)
+    if (xt_enabled == 1)
     {
-        p1 = lineBuff1;
-        *p1 = '\0';
-        p2 = lineBuff2;
-        *p2 = '\0';
-        strcat (p1, xt_pTreeCol);         /* Set color of tree structure.      */
-        pBranch = & xt_pTree [index];
-        level = pBranch->level;
-
-        node [level] = index;
-        endOfBlock = 0;
-
-        /* First build the remainder of the family tree for this node by
-         * storing the parent and parents parent... etc in the node[] array.
-         * The first entry (node[0)) should always be main(), while the last
-         * entry is the function we are about to print.  The node[] array
-         * therefore represents the family tree for this function.
-         */
-        for (n = level;  n != 0;  n--)
-        {
-            parentIdx = pBranch->parent;
-            node [n - 1] = parentIdx;
-            pBranch = & xt_pTree [parentIdx];
-        }
-
-        /* Scan the family tree creating the appropriate pretty printing strings.
+        /* In adaptive mode, a suppressed function costs only this check.
+         * Otherwise note the start of its outermost invocation so that the
+         * average duration can be worked out when it returns.
          */
-        for (n = 1;  n <= level;  n++)
+        if (xt_adaptive == 1 && (pFunc = XT_FindFunction (this_fn)) != NULL)
         {
-            idx = node [n];                 /* Get branch index of this node  */
-            idxp = xt_pTree [idx].parent;   /* Get index of parent.           */
-            pBranch = & xt_pTree [idxp];
-
-            if (pBranch->lastChild > index)
+            if (pFunc->suppressed == 1)
             {
-                if (n == level)
-                    strcat (p2, xt_teeHoriz);
-                else
-                    strcat (p1, xt_vlinSpace);
-            }
-            else if (pBranch->lastChild < index)
-               strcat (p1, xt_space);
-            else                            /*  pBranch->lastChild == index   */
-            {
-               strcat (p2, xt_LHoriz);
-               endOfBlock = (xt_pTree [idx].lastChild == 0) ? 1 : 0;
+                pFunc->skipped++;
+                return;
             }
+            if (pFunc->active++ == 0)
+                pFunc->enterTime = XT_GetClock ();
         }
 
-        n = node [level];                   /* Index of current node.         */
-        n = xt_pTree [n].nameIndx;          /* Index of name of this node.    */
-
-        /* If, by some miracle, line number information has been provided for
-         * this function, we print it in the small temp buffer for that,
-         * otherwise, it will just be an empty buffer.
-         */
-        lineNoBuff [0] = '\0';              /* better safe than sorry!!!      */
-        if (xt_pTree [n].lineNo != 0)
-            sprintf (lineNoBuff, "[%d] ", xt_pTree [n].lineNo);
-
-        strcat (p2, xt_pNameCol);           /* Set color of names.            */
-        XT_OUT ("%s%s%s%s" XT_COL_RESET, lineBuff1, lineBuff2, lineNoBuff, & xt_funcNames [n]);
-
-        /* Now if we are recording execution times, calculate the total time
-         * spent in this function (as well as all it's child functions).
-         * NOTE:  The execution time for this function alone is the time
-         * calculated here minus the execution times of all it's children.
-         */
-        if (xt_timer != XT_TIMER_DISABLED)
-            XT_PrintElapsedTime (pBranch->enterTime, pBranch->exitTime);
-
-        XT_OUT ("\n");
+        if (xt_control == 1)
+            XT_StackPush (this_fn);
 
-        /* Print gaps at the end of blocks if requested.
+        /* Retreive information about the symbol for this_fn addr.  Addresses
+         * may be particularly useful for debugging with GDB, but they are
+         * very uninformative to read.  what we want is the actual function
+         * name.
          */
-        if (xt_addGaps == 1 && endOfBlock == 1)
-            XT_OUT ("%s\n", lineBuff1);
+        if (dladdr (this_fn, & info) != 0)
+            XT_Trace ((info.dli_sname != NULL) ? info.dli_sname : "???", NULL);
     }
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * This function is called to add the current function as the next entry on the
- * function call trace tree.  The trace tree is stored as an array of XTBranch
- * items.  As more function calls are added, the memory requirements are
- * automatically expaned to account for the additional requirements.  Each
- * entry stores the index to the function name stored in the xt_funcNames
- * character array, the level of the function in the tree and, line number that
- * the function was called from (usually 0 as this info is difficult to get).
+ * The general exit path, used with any options.  It is also used by calls
+ * that return before the first call has chosen the paths.
  */
 
 __attribute__ ((no_instrument_function))
-void XT_AddBranch (const char *p, unsigned level)
+void XT_ExitAny (void *this_fn)
 {
-    XTBranch  *pBranch;
-
-    if (xt_pTree == NULL)            /* If NULL, no mem allocated yet.      */
-    {
-        xt_treeSize = 1000;          /* Initial buffer size.                */
-        xt_pTree = (XTBranch *) calloc ((size_t) xt_treeSize, sizeof (XTBranch));
-        xt_nextBranch = 0;           /* Init index to next avail branch.    */
-    }
-    else if (xt_treeSize <= xt_nextBranch)               /* Enough room for */
-    {                                                    /* next symbol?    */
-        xt_treeSize += 500;          /* Expanded buffer size.               */
-        xt_pTree = (XTBranch *) realloc (xt_pTree, (size_t) xt_treeSize * sizeof (XTBranch));
-    }
+    XTFunc    *pFunc;
 
-    if (xt_pTree != NULL)
+    if (xt_enabled == 1)
     {
-        xt_exitNodeIndex = xt_nextBranch;
-        pBranch = & xt_pTree [xt_nextBranch];     /* Get ptr to next branch */
+        /* Suppressed functions have no node to close.  For all others, the
+         * adaptive counters are updated and the function may be suppressed.
+         */
+        if (xt_adaptive == 1 && (pFunc = XT_FindFunction (this_fn)) != NULL)
+        {
+            if (pFunc->suppressed == 1)
+                return;
+            XT_AdaptExit (pFunc);
+        }
 
-        pBranch->nameIndx = XT_AddFunctionName (p) - 1; /* Add name and get index */
-        pBranch->level = level;           /* Store level of function call.  */
-        pBranch->lineNo = xt_lineNo;      /* Save line No. if available.    */
-        pBranch->enterTime = XT_GetTime ();   /* Store the current time.    */
-        pBranch->lastChild = 0;
-        XT_LinkToParent (pBranch);
+        if (xt_control == 1)
+            XT_StackPop (this_fn);
 
-        xt_nextBranch++;             /* Update index to next entry in array.*/
-        xt_lineNo = 0;
+        XT_Return ();
     }
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * null terminated function names are stored in along character buffer one
- * after the other.  As memory requirements grow, the buffer is resized
- * automatically.  Since resizing does not guarantee the buffer will not be
- * moved, rather than storing pointers to the required string, an index is used
- * giving the offset to the function name from the start of the buffer.
- * NOTE the returned value is 1 more than the index, so needs to be decremented
- * to use it.  If an error occurs, zero is returned.
+ * Record the call to this_fn, or its return, as XT_Trace() and XT_Return() do
+ * in normal mode.  flags is always a constant, made of the XT_REC_ flags for
+ * the data kept with each node (see XT_RecordFlags()) and XT_REC_TIMED when
+ * calls are timed, with the clock chosen by XT_EnterFirst().  The compiler
+ * therefore leaves out the code for the data not kept.  If tracing stops,
+ * XT_Disable() replaces these paths, so they need not test for it.
  */
 
-__attribute__ ((no_instrument_function))
-unsigned XT_AddFunctionName (const char *p)
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_EnterNode (void *this_fn, unsigned flags)
 {
-    unsigned  len, rtn;
+    Dl_info      info;
 
-    len = strlen (p) + 1;            /* Symbol name length including null.  */
+    if (dladdr (this_fn, & info) == 0)
+        return;
 
-    if (xt_funcNames == NULL)        /* If NULL, no mem allocated yet.      */
-    {
-        xt_nameBuffSize = 10000;     /* Initial buffer size.                */
-        xt_funcNames = (char *) calloc (xt_nameBuffSize, sizeof (char));
-        xt_nextAvail = 0;            /* Init index to next avail slot.      */
-    }
-    else if (xt_nameBuffSize - xt_nextAvail <= len)      /* Enough room for */
-    {                                                    /* next symbol?    */
-        xt_nameBuffSize += 5000;    /* Expanded buffer size.                */
-        xt_funcNames = (char *) realloc (xt_funcNames, xt_nameBuffSize);
-    }
+    if (xt_level > XT_LEVEL_MAX)
+        __atomic_fetch_add (& xt_dropNodes, 1, __ATOMIC_RELAXED);
+    else
+        XT_AddNode ((info.dli_sname != NULL) ? info.dli_sname : "???", NULL, xt_level,
+                    ((flags & XT_REC_TIMED) != 0) ? XT_TIMER_ELAPSED : XT_TIMER_DISABLED, flags);
 
-    if (xt_funcNames != NULL)
+    if (++xt_level > xt_maxLvl)
+        xt_maxLvl = xt_level;
+}
+
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_ExitNode (unsigned flags)
+{
+    if (--xt_level <= XT_LEVEL_MAX && xt_pLevel != NULL)
+        XT_CloseNode (xt_level, ((flags & XT_REC_TIMED) != 0) ? XT_TIMER_ELAPSED : XT_TIMER_DISABLED,
+                      flags);
+    xt_lineNo = 0;                         /* Reset for next function.  */
+
+    if (xt_level == 0)                     /* main() has returned.      */
     {
-        strncpy (& xt_funcNames [xt_nextAvail], p, len);  /* Copy to buffer */
-        rtn = xt_nextAvail + 1;     /* Save the index to symbol just saved. */
-        xt_nextAvail += len;        /* Update next avail slot index.        */
-        return (rtn);               /* Return index to current symbol.      */
+        XT_Finish ();
+        XT_Close ();
     }
-    return (0);                     /* Error.  Symbol not saved.            */
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * Find the parent for this object by searching backwards through the tree from
- * this branch until we find the first function at the next lowest level (closer
- * to main() ).  That function must be our parent.  The parent index is stored
- * for this node and the parent's last child is updated to reflect the latest
- * node.
+ * The record paths, used when every call just adds a node to the tree, i.e.
+ * not in real time or adaptive mode, or with the control socket or flushing.
+ * There is one for each set of flags that can be chosen, and each does the
+ * same as the general paths for those options without testing any of them.
+ * Only the line number is still tested, as it is set by the _ macro as the
+ * program runs.
  */
 
-__attribute__ ((no_instrument_function))
-void XT_LinkToParent (XTBranch *pBranch)
-{
-    unsigned  n;
+#define XT_RECORD_PATH(flags)                                                  \
+static __attribute__ ((no_instrument_function))                                \
+void XT_EnterRecord##flags (void *this_fn)                                     \
+{                                                                              \
+    XT_EnterNode (this_fn, flags);                                             \
+}                                                                              \
+                                                                               \
+static __attribute__ ((no_instrument_function))                                \
+void XT_ExitRecord##flags (void *this_fn)                                      \
+{                                                                              \
+    UNUSED (this_fn);                                                          \
+    XT_ExitNode (flags);                                                       \
+}
+
+XT_RECORD_PATH (0)   XT_RECORD_PATH (1)   XT_RECORD_PATH (3)   XT_RECORD_PATH (5)
+XT_RECORD_PATH (7)   XT_RECORD_PATH (8)   XT_RECORD_PATH (9)   XT_RECORD_PATH (11)
+XT_RECORD_PATH (13)  XT_RECORD_PATH (15)  XT_RECORD_PATH (16)  XT_RECORD_PATH (17)
+XT_RECORD_PATH (19)  XT_RECORD_PATH (21)  XT_RECORD_PATH (23)  XT_RECORD_PATH (24)
+XT_RECORD_PATH (25)  XT_RECORD_PATH (27)  XT_RECORD_PATH (29)  XT_RECORD_PATH (31)
+
+/* The record paths, indexed by their flags.  The CPU time and pruning need
+ * the calls to be timed, so there are no paths for them without XT_REC_TIMED.
+ */
+    static const XTHook xt_recordEnter [XT_REC_PATHS] =
+    {
+        [0]  = XT_EnterRecord0,   [1]  = XT_EnterRecord1,   [3]  = XT_EnterRecord3,
+        [5]  = XT_EnterRecord5,   [7]  = XT_EnterRecord7,   [8]  = XT_EnterRecord8,
+        [9]  = XT_EnterRecord9,   [11] = XT_EnterRecord11,  [13] = XT_EnterRecord13,
+        [15] = XT_EnterRecord15,  [16] = XT_EnterRecord16,  [17] = XT_EnterRecord17,
+        [19] = XT_EnterRecord19,  [21] = XT_EnterRecord21,  [23] = XT_EnterRecord23,
+        [24] = XT_EnterRecord24,  [25] = XT_EnterRecord25,  [27] = XT_EnterRecord27,
+        [29] = XT_EnterRecord29,  [31] = XT_EnterRecord31
+    };
+    static const XTHook xt_recordExit [XT_REC_PATHS] =
+    {
+        [0]  = XT_ExitRecord0,    [1]  = XT_ExitRecord1,    [3]  = XT_ExitRecord3,
+        [5]  = XT_ExitRecord5,    [7]  = XT_ExitRecord7,    [8]  = XT_ExitRecord8,
+        [9]  = XT_ExitRecord9,    [11] = XT_ExitRecord11,   [13] = XT_ExitRecord13,
+        [15] = XT_ExitRecord15,   [16] = XT_ExitRecord16,   [17] = XT_ExitRecord17,
+        [19] = XT_ExitRecord19,   [21] = XT_ExitRecord21,   [23] = XT_ExitRecord23,
+        [24] = XT_ExitRecord24,   [25] = XT_ExitRecord25,   [27] = XT_ExitRecord27,
+        [29] = XT_ExitRecord29,   [31] = XT_ExitRecord31
+    };
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the call to this_fn, or its return, as XT_Trace() and XT_Return() do
+ * in real time mode.  timed and lines are constants, set when times are
+ * printed and when the tree lines are drawn (xt_traceLines).
+ */
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_EnterPrinted (void *this_fn, int timed, int lines)
+{
+    Dl_info      info;
+
+    if (dladdr (this_fn, & info) == 0)
+        return;
+
+    XT_PrintEnter ((info.dli_sname != NULL) ? info.dli_sname : "???", timed, lines);
+
+    if (xt_level++ > 1)                         /* Incr stack level.          */
+        xt_prevLvl++;                           /* Incr ptrev stack level.    */
+    if (xt_level > xt_maxLvl)
+        xt_maxLvl = xt_level;
+}
+
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_ExitPrinted (int lines)
+{
+    xt_prevLvl = xt_level;
+    xt_level--;
+
+    XT_PrintExit (lines);
+    xt_lineNo = 0;                         /* Reset for next function.  */
+
+    if (xt_level == 0)
+        XT_Close ();
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The real time paths, used in real time mode unless adaptive mode or the
+ * control socket is in use.  The functions are either indented or drawn with
+ * tree lines, with or without times.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_EnterIndent (void *this_fn)
+{
+    XT_EnterPrinted (this_fn, 0, 0);
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_EnterIndentTimed (void *this_fn)
+{
+    XT_EnterPrinted (this_fn, 1, 0);
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_EnterLines (void *this_fn)
+{
+    XT_EnterPrinted (this_fn, 0, 1);
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_EnterLinesTimed (void *this_fn)
+{
+    XT_EnterPrinted (this_fn, 1, 1);
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_ExitIndent (void *this_fn)
+{
+    UNUSED (this_fn);
+    XT_ExitPrinted (0);
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_ExitLines (void *this_fn)
+{
+    UNUSED (this_fn);
+    XT_ExitPrinted (1);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Choose the enter and exit paths once the options are known.  When sampling,
+ * only the shadow stack is kept.  When each call just adds a node to the tree,
+ * the record path built for the data kept with each node is used (see
+ * XT_RecordFlags()), and in real time mode without adaptive mode or the
+ * control socket, the real time path built for the way lines are printed.
+ * The general paths handle everything else: adaptive mode, the control socket
+ * and flushing.  The paths are chosen again whenever an option is dropped,
+ * e.g. when there is not enough memory for the counters.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SelectHooks (void)
+{
+    unsigned   flags;
+
+#ifdef XT_X_SAMPLE
+    if (xt_sampleRate > 0)
+    {
+        xt_pEnter = XT_SamplePush;
+        xt_pExit = XT_ExitSample;
+        return;
+    }
+#endif
+
+    if (xt_adaptive == 1 || xt_control == 1)
+    {
+        xt_pEnter = XT_EnterAny;
+        xt_pExit = XT_ExitAny;
+    }
+    else if (xt_realTime == 1)
+    {
+        if (xt_traceLines == 1)
+            xt_pEnter = (xt_timer != XT_TIMER_DISABLED) ? XT_EnterLinesTimed : XT_EnterLines;
+        else
+            xt_pEnter = (xt_timer != XT_TIMER_DISABLED) ? XT_EnterIndentTimed : XT_EnterIndent;
+        xt_pExit = (xt_traceLines == 1) ? XT_ExitLines : XT_ExitIndent;
+    }
+    else if (xt_flushDepth == 0)
+    {
+        flags = XT_RecordFlags ();
+        if (xt_timer != XT_TIMER_DISABLED)
+            flags |= XT_REC_TIMED;
+        xt_pEnter = xt_recordEnter [flags];
+        xt_pExit = xt_recordExit [flags];
+    }
+    else
+    {
+        xt_pEnter = XT_EnterAny;
+        xt_pExit = XT_ExitAny;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Stop tracing, as something needed could not be set up.  The hooks are
+ * pointed at a path that does nothing, so the paths need not test for it.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Disable (void)
+{
+    xt_enabled = 0;
+    xt_pEnter = XT_HookNone;
+    xt_pExit = XT_HookNone;
+}
+
+
+__attribute__ ((no_instrument_function))
+void XT_HookNone (void *this_fn)
+{
+    UNUSED (this_fn);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This function is called at the beginning of each function in the program and
+ * it operates in one of two ways.  In normal mode, function calls are stored
+ * in memory and when the main() function is about to exit.  In this way, the
+ * call tree can be printed as a pretty structure.
+ * In real time mode, the indented function name is printed immediately.  This
+ * is particularly useful if the program terminates unexpectedly (e.g. such as
+ * when a segmentation fault occurs).  Under these circumstances, it is not
+ * possible to get the pretty print version of the call tree that happens at
+ * the end of the program.  pId is NULL for functions, and the name id cached
+ * at the call site for spans (see XT_AddBranch()).
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Trace (const char *func, unsigned *pId)
+{
+    if (xt_realTime == 1)                      /*   --- REAL TIME MODE ---   */
+        XT_PrintEnter (func, (xt_timer != XT_TIMER_DISABLED) ? 1 : 0, xt_traceLines);
+    else                                       /*    --- NORMAL MODE ---     */
+    {
+        /* The normal mode.  In this mode we want to generate a pretty tree
+         * structure, but we can't know how to draw some nodes before exiting
+         * a function (which may not happen for some lines later).  To overcome
+         * this issue, all the call tree is stored and printed out at the end
+         * of the program.  The problem with this is that problems such as a
+         * segmentation fault which cause the program to prematurely finish
+         * prevent the call tree from being generated.
+         */
+        if (xt_level > XT_LEVEL_MAX)
+            __atomic_fetch_add (& xt_dropNodes, 1, __ATOMIC_RELAXED);
+        else
+        {
+            if (xt_flushDepth > 0)
+                XT_FlushEnter (xt_level);
+            XT_AddBranch (func, pId, xt_level);
+        }
+    }
+
+    if (xt_level++ > 1)                         /* Incr stack level.          */
+        xt_prevLvl++;                           /* Incr ptrev stack level.    */
+    if (xt_level > xt_maxLvl)
+        xt_maxLvl = xt_level;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This function performs all the pretty printing for the function call tree in
+ * non-realtime mode.  In this mode, the data is stored in the compact tree
+ * described with xt_pLevel.
+ * In realtime mode, printing is done immediately in the XT_Trace() function.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Print (void)
+{
+#ifdef XT_X_THREADS
+    if (xt_printThreads != 1 && XT_PrintParallel () == 0)
+        return;
+#endif
+    XT_PrintRange (0, xt_nextBranch, 1);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Record the return of the running function, or the end of a span, at the
+ * current level.  When main() returns, the call tree is printed and the
+ * memory used to record it released.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Return (void)
+{
+    unsigned   i;
+
+    xt_prevLvl = xt_level;
+    xt_level--;
+
+    if (xt_realTime == 1)
+        XT_PrintExit (xt_traceLines);
+    else
+    {
+       /* Record the exit, then set the next exit node as this node's
+        * parent.  Functions too deep to be recorded have no node.
+        */
+        if (xt_level <= XT_LEVEL_MAX && xt_pLevel != NULL)
+        {
+            i = xt_exitNodeIndex;
+            XT_CloseBranch (xt_level);
+
+            if (xt_flushDepth > 0 && i < xt_nextBranch)  /* Not pruned.  */
+                XT_FlushExit (i);
+        }
+
+        /* Only need to tidy up if we are not in real time mode.
+         */
+        if (xt_level == 0)
+        {
+            /* Exiting at level 0 means we are exiting main(), so generate
+             * output and clean up after ourselves.
+             */
+            XT_Finish ();
+        }
+    }
+    xt_lineNo = 0;                         /* Reset for next function.  */
+
+    if (xt_level == 0)
+        XT_Close ();
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the call to func in real time mode, indented for the current level.
+ * In real time mode, the output is generated as the program runs, so it is
+ * available even if the program crashes before it can print the tree.  timed
+ * is set when times are printed and lines when the tree lines are drawn
+ * (xt_traceLines).  The real time paths pass them as constants (see
+ * XT_EnterPrinted()).
+ */
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_PrintEnter (const char *func, int timed, int lines)
+{
+    unsigned  i;
+    char     *pOut;
+    char      lineBuff [512];                  /* Print line buffer.         */
+
+    /* If asked to print times in real time mode, get the start time of
+     * the program if we are just entered the main() function.
+     */
+    if (timed == 1 && xt_level == 0)
+        xt_realTimeStart = XT_GetTime ();
+
+    XT_PrintInit ();
+
+    lineBuff[0] = '\0';
+    pOut = lineBuff;
+    if (lines == 1)
+    {
+        if (xt_level >= 1)
+        {
+            for (i = XT_INDENT * (xt_level - 1); i > 0;  i--)
+                *pOut++ = ' ';
+            strcpy (pOut, xt_LHoriz);
+        }
+    }
+    else
+    {
+        for (i = XT_INDENT * xt_level; i > 0;  i--)
+            *pOut++ = ' ';
+        *pOut = '\0';
+    }
+    XT_OUT ("%s%s", lineBuff, func);
+
+    if (timed == 1)
+        XT_PrintElapsedTime (xt_realTimeStart, XT_GetTime ());
+
+    XT_OUT ("\n");
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the return of a function in real time mode, once xt_level has been
+ * lowered to its level.  lines is set as for XT_PrintEnter().
+ */
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_PrintExit (int lines)
+{
+    unsigned   i;
+    char      *pOut, lineBuff[512];
+
+    if (lines == 1)
+    {
+        pOut = lineBuff;
+        if (xt_prevLvl > 1)
+        {
+            for (i = XT_INDENT * (xt_level - 1); i > 0;  i--)
+                *pOut++ = ' ';
+        }
+        if (xt_prevLvl > 0)            /* Don't output for main()   */
+        {
+            strcpy (pOut, xt_SHoriz);
+            XT_OUT ("%s\n", lineBuff);
+        }
+    }
+    else
+        if (xt_level > 0 && (xt_maxLvl - xt_level) >= 2)
+        {
+            XT_OUT ("\n");
+            xt_maxLvl = xt_level;
+        }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Tidy up once main() has returned and everything has been printed: list the
+ * functions suppressed by adaptive mode, close the trace file and remove the
+ * control socket.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Close (void)
+{
+    if (xt_adaptive == 1)
+        XT_PrintSuppressed ();
+
+    if (xt_pOutputFile != NULL)
+        fclose (xt_fp);
+
+#ifdef XT_X_CONTROL
+    if (xt_control == 1)
+        unlink (xt_ctlPath);
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Start a span, a region of the running function that is recorded, timed and
+ * printed as if it were a function called from there.  The XT_SPAN_BEGIN()
+ * and XT_SPAN() macros pass the name, a string literal, along with the name
+ * id kept at their call site, which also tags the span.  The span is noted in
+ * xt_spans so that only it can be ended as a span.  Returns the span, whose
+ * level is 0 if it was not started.  Spans are not kept on the shadow stacks,
+ * are never suppressed by adaptive mode and are ignored when sampling, as no
+ * function is then recorded (xt_level stays 0).
+ */
+
+__attribute__ ((no_instrument_function))
+XTSpan XT_SpanScope (const char *pName, unsigned *pId)
+{
+    XTSpan    span = {0, pId};
+
+    if (xt_enabled == 1 && xt_level > 0 && xt_nSpans < XT_SPAN_MAX)
+    {
+        XT_Trace (pName, pId);
+        span.level = xt_level;
+        xt_spans [xt_nSpans++] = span;
+    }
+    return (span);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * End the span started last, if it is the innermost node still open.  Spans
+ * whose node has already been closed, by the return of the function they were
+ * started in, are forgotten first.  A function is never ended here, so a
+ * stray XT_SPAN_END() does nothing.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SpanEnd (void)
+{
+    while (xt_nSpans > 0 && xt_spans [xt_nSpans - 1].level > xt_level)
+        xt_nSpans--;
+
+    if (xt_enabled == 1 && xt_nSpans > 0 && xt_spans [xt_nSpans - 1].level == xt_level)
+    {
+        xt_nSpans--;
+        XT_Return ();
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * End the span started by XT_SPAN() as the block holding it is left.  It is
+ * called by the compiler with the span XT_SpanScope() returned, and only ends
+ * it if that span, tagged by its name id, is the innermost node still open.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SpanCleanup (XTSpan *pSpan)
+{
+    while (xt_nSpans > 0 && xt_spans [xt_nSpans - 1].level > xt_level)
+        xt_nSpans--;
+
+    if (pSpan->level != 0 && xt_enabled == 1 && xt_nSpans > 0 &&
+        xt_spans [xt_nSpans - 1].level == pSpan->level &&
+        xt_spans [xt_nSpans - 1].pId == pSpan->pId && xt_level == pSpan->level)
+    {
+        xt_nSpans--;
+        XT_Return ();
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Produce everything reported once main() has returned: the call tree, then
+ * the hot paths and the profile when these are wanted.  The tree is then
+ * released.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Finish (void)
+{
+#ifdef XT_X_SPILL
+    XT_SpillFinish ();                 /* All spilled blocks written.   */
+#endif
+    if (xt_holdLen > 0)
+        XT_HoldWrite (1);              /* Anything left from flushing.  */
+    XT_Print ();
+    if (xt_hotPaths > 0 && xt_flushDepth == 0)
+        XT_PrintHotPaths ();
+    if (xt_pProfileFile != NULL && xt_flushDepth == 0)
+        XT_SaveProfile ();
+    XT_Cleanup ();
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the nodes first to end - 1, which must be one or more complete
+ * subtrees.  The nodes are decoded a window at a time by XT_WalkNext(), which
+ * works out whether each is the last child of its parent, except for the
+ * first node, whose parent may not have all its children yet when a subtree is
+ * flushed, so this is given by rootLast instead.  The lines drawn for levels
+ * above the first node come from the state left by earlier calls.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintRange (unsigned first, unsigned end, int rootLast)
+{
+    XTWalk        walk;
+    const XTNode *pNode;
+    XTAlloc      *pTotals = NULL;
+
+    XT_PrintInit ();                     /* Initialise elements for printing  */
+    XT_Demangle ();
+
+    if (xt_allocs == 1)
+        pTotals = XT_AllocTotals (first, end);
+
+    if (XT_WalkInit (& walk, first, end, rootLast) != 0)
+    {
+        fprintf (stderr, "Not enough memory to print the call tree\n");
+        XT_FREE (pTotals);
+        return;
+    }
+
+    while ((pNode = XT_WalkNext (& walk)) != NULL)
+        XT_PrintNode (pNode, 0, (pTotals != NULL) ? & pTotals [pNode->index - first] : NULL);
+
+    XT_WalkFree (& walk);
+    XT_FREE (pTotals);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print a single node.  pNode->last is non zero if the node is the last child
+ * of its parent, and running is non zero if the function has not yet
+ * returned, in which case no times are printed.  The line starts with a
+ * vertical line or spaces for each level above the node, depending on whether
+ * the node printed at that level has later siblings, followed by a tee or 'L'
+ * piece.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintNode (const XTNode *pNode, int running, const XTAlloc *pTotal)
+{
+    int        endOfBlock;
+    unsigned   n, level;
+    char      *p;
+    const char *pTee;
+    char       lineNoBuff [16], hold [3];
+
+    level = pNode->level;
+    if (XT_PrintReserve (level) != 0)
+        return;
+
+    xt_pBars [level] = (pNode->last == 0) ? 1 : 0;
+
+    p = xt_pLine;                        /* Set color of tree structure.      */
+    strcpy (p, xt_pTreeCol);
+    p += strlen (p);
+    for (n = 1;  n < level;  n++)        /* Lines for the levels above.       */
+    {
+        if (n < XT_FLUSH_MAX && xt_holdAt [n] != 0)
+        {
+            *p++ = XT_HOLD_BAR;          /* Not known yet (XT_HoldResolve()). */
+            *p++ = (char) (' ' + n);
+            continue;
+        }
+        strcpy (p, (xt_pBars [n] == 1) ? xt_vlinSpace : xt_space);
+        p += strlen (p);
+    }
+    *p = '\0';
+
+    pTee = (level == 0) ? "" : (pNode->last != 0) ? xt_LHoriz : xt_teeHoriz;
+    if (running == 1 && level > 0 && level < XT_FLUSH_MAX && xt_holdAt [level] != 0)
+    {
+        hold [0] = XT_HOLD_TEE;
+        hold [1] = (char) (' ' + level);
+        hold [2] = '\0';
+        pTee = hold;
+    }
+
+    /* A block ends with the last child of a parent that has no children of
+     * its own.
+     */
+    endOfBlock = (level > 0 && pNode->last != 0 && pNode->leaf != 0) ? 1 : 0;
+
+    /* If, by some miracle, line number information has been provided for
+     * this function, we print it in the small temp buffer for that,
+     * otherwise, it will just be an empty buffer.
+     */
+    lineNoBuff [0] = '\0';              /* better safe than sorry!!!      */
+    if (pNode->lineNo != 0)
+        sprintf (lineNoBuff, "[%d] ", pNode->lineNo);
+
+    XT_OUT ("%s%s%s%s%s" XT_COL_RESET, xt_pLine, pTee, xt_pNameCol, lineNoBuff,
+            & xt_funcNames [pNode->nameIndx]);
+
+    /* Now if we are recording execution times, calculate the total time
+     * spent in this function (as well as all it's child functions).
+     * NOTE:  The execution time for this function alone is the time
+     * calculated here minus the execution times of all it's children.
+     */
+    if (running == 0)
+    {
+        if (xt_timer != XT_TIMER_DISABLED)
+            XT_PrintElapsedTime (0.0, (double) (pNode->exitTime - pNode->enterTime) / 1000000000.0);
+
+        if (xt_timer == XT_TIMER_BOTH)
+            XT_PrintCpuTime (pNode->exitTime - pNode->enterTime, xt_pCpu [pNode->index]);
+
+#ifdef XT_X_SAMPLE
+        if (xt_timer == XT_TIMER_SAMPLES)
+            XT_OUT ("  (%llu samples)", (pNode->exitTime - pNode->enterTime) / xt_samplePeriod);
+#endif
+
+        if (xt_counters == 1)
+            XT_PrintCounters (& xt_pCounts [pNode->index * xt_nCounters]);
+
+        if (pTotal != NULL)
+            XT_PrintAllocs (pTotal, & xt_pAllocs [pNode->index]);
+
+        if (pNode->index < xt_prunedSize && xt_pPruned [pNode->index].calls != 0)
+        {
+            XT_OUT ("  <pruned %llu calls", xt_pPruned [pNode->index].calls);
+            XT_PrintElapsedTime (0.0, (double) xt_pPruned [pNode->index].ticks / 1000000000.0);
+            XT_OUT (">");
+        }
+    }
+
+    XT_OUT ("\n");
+
+    /* Print gaps at the end of blocks if requested.
+     */
+    if (xt_addGaps == 1 && endOfBlock == 1)
+        XT_OUT ("%s\n", xt_pLine);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Make sure the print state and line buffer can hold a tree with the given
+ * deepest level.  Returns 0 if they can, or -1 if the memory is not available.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_PrintReserve (unsigned level)
+{
+    unsigned        n;
+    char           *pLine;
+    unsigned char  *pBars;
+
+    if (level < xt_printLevels)
+        return (0);
+
+    n = (level + 64) & ~31u;             /* Leave room for a little more.     */
+    pBars = (unsigned char *) XT_REALLOC (xt_pBars, (size_t) n);
+    if (pBars == NULL)
+        return (-1);
+    xt_pBars = pBars;
+
+    pLine = (char *) XT_REALLOC (xt_pLine, (size_t) n * XT_PIECE_MAX + 64);
+    if (pLine == NULL)
+        return (-1);
+    xt_pLine = pLine;
+
+    memset (& xt_pBars [xt_printLevels], 0, (size_t) (n - xt_printLevels));
+    xt_printLevels = n;
+    return (0);
+}
+
+
+
+#ifdef XT_X_THREADS
+
+/*-----------------------------------------------------------------------------
+ * Print the whole tree using several threads, which is worth doing for very
+ * large trees.  The tree is split at a depth chosen by XT_PrintDepth(), where
+ * each node and its subtree, along with the nodes above that depth (the spine,
+ * whose times and later siblings are found without decoding their subtrees),
+ * can be printed given only the vertical lines of its ancestors.  The nodes
+ * are grouped into jobs, which the threads take in order and print into their
+ * own buffers, while the calling thread writes the finished buffers out in
+ * order with writev().  Only a limited number of jobs can be waiting to be
+ * written, which limits the memory used.  Returns 0 if the tree has been
+ * printed or -1 if it should be printed by XT_PrintRange() instead.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_PrintParallel (void)
+{
+    unsigned      i, j, k, n, level, nThreads, nStarted, nSpine, target, sp;
+    unsigned      stack [XT_PAR_DEPTH];
+    int           nIov, fd, rtn = -1;
+    long          cpus;
+    XTPool        pool;
+    XTJob        *pJob;
+    XTAlloc      *pTotals = NULL;
+    pthread_t    *pThreads;
+    struct iovec  iov [64];
+
+    n = xt_nextBranch;
+    cpus = sysconf (_SC_NPROCESSORS_ONLN);
+    nThreads = (xt_printThreads > 0) ? (unsigned) xt_printThreads : (cpus > 0) ? (unsigned) cpus : 1;
+    if (n < XT_PAR_NODES || nThreads < 2 || XT_Level (0) != 0)
+        return (-1);
+
+    XT_PrintInit ();
+    XT_Demangle ();
+    memset (& pool, 0, sizeof (XTPool));
+    target = n / (nThreads * XT_PAR_JOBS);
+    if (target < XT_WINDOW)
+        target = XT_WINDOW;
+    pool.depth = XT_PrintDepth (target);
+
+    for (nSpine = 0, i = 0;  i < n;  i++)
+        if (XT_Level (i) < pool.depth)
+            nSpine++;
+    pool.pSpine = (XTSpine *) XT_CALLOC ((size_t) nSpine + 1, sizeof (XTSpine));
+    pool.pJobs = (XTJob *) XT_CALLOC ((size_t) (n / target) + 2, sizeof (XTJob));
+    pThreads = (pthread_t *) XT_CALLOC (nThreads, sizeof (pthread_t));
+    if (xt_allocs == 1)
+        pTotals = XT_AllocTotals (0, n);
+    if (pool.pSpine == NULL || pool.pJobs == NULL || pThreads == NULL ||
+        (xt_allocs == 1 && pTotals == NULL))
+        goto done;
+    pool.pTotals = pTotals;
+
+    /* Find the spine nodes and their subtrees, held on a stack by level, and
+     * start a new job at the first node at or above the split depth once the
+     * current job is big enough.
+     */
+    pJob = pool.pJobs;
+    pool.nJobs = 1;
+    for (nSpine = 0, sp = 0, i = 0;  i < n;  i++)
+    {
+        level = XT_Level (i);
+        if (level > pool.depth)
+            continue;
+        while (sp > level)
+            pool.pSpine [stack [--sp]].end = i;
+
+        if (i - pJob->first >= target)
+        {
+            pJob->end = i;
+            pJob = & pool.pJobs [pool.nJobs++];
+            pJob->first = i;
+            pJob->spine = nSpine;
+            memcpy (pJob->anc, stack, (size_t) sp * sizeof (unsigned));
+        }
+        if (level < pool.depth)
+        {
+            pool.pSpine [nSpine].index = i;
+            pool.pSpine [nSpine].end = n;
+            stack [sp++] = nSpine++;
+        }
+    }
+    pJob->end = n;
+
+    pool.ahead = nThreads * 2;
+    pthread_mutex_init (& pool.lock, NULL);
+    pthread_cond_init (& pool.cond, NULL);
+    for (nStarted = 0;  nStarted < nThreads;  nStarted++)
+        if (pthread_create (& pThreads [nStarted], NULL, XT_PrintWorker, & pool) != 0)
+            break;
+
+    if (nStarted > 0)
+    {
+        /* Write each run of finished jobs as soon as the first is done.
+         */
+        fflush (xt_fp);
+        fd = fileno (xt_fp);
+        for (k = 0;  k < pool.nJobs;  k = j)
+        {
+            pthread_mutex_lock (& pool.lock);
+            while (pool.pJobs [k].done == 0)
+                pthread_cond_wait (& pool.cond, & pool.lock);
+            for (j = k;  j < pool.nJobs && j - k < 64 && pool.pJobs [j].done != 0;  j++)
+                ;
+            pthread_mutex_unlock (& pool.lock);
+
+            for (nIov = 0, i = k;  i < j;  i++)
+            {
+                if (pool.pJobs [i].pOut == NULL)
+                    fprintf (stderr, "Not enough memory to print the call tree\n");
+                else if (pool.pJobs [i].len > 0)
+                {
+                    iov [nIov].iov_base = pool.pJobs [i].pOut;
+                    iov [nIov++].iov_len = pool.pJobs [i].len;
+                }
+            }
+            XT_WriteAll (fd, iov, nIov);
+            for (i = k;  i < j;  i++)
+                XT_FREE (pool.pJobs [i].pOut);   /* From open_memstream().   */
+
+            pthread_mutex_lock (& pool.lock);
+            pool.written = j;
+            pthread_cond_broadcast (& pool.cond);
+            pthread_mutex_unlock (& pool.lock);
+        }
+        rtn = 0;
+    }
+
+    while (nStarted > 0)
+        pthread_join (pThreads [--nStarted], NULL);
+    pthread_mutex_destroy (& pool.lock);
+    pthread_cond_destroy (& pool.cond);
+
+done:
+    XT_FREE (pool.pSpine);
+    XT_FREE (pool.pJobs);
+    XT_FREE (pThreads);
+    XT_FREE (pTotals);
+    return (rtn);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Choose the level to split the tree at when printing in parallel: the
+ * shallowest at which no subtree has more than target nodes, or failing that,
+ * the one whose largest subtree is smallest.  The size of the subtree of each
+ * node at the levels considered is found in a single pass, as it ends at the
+ * next node at the same or a lower level.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_PrintDepth (unsigned target)
+{
+    unsigned   i, l, level, top = 0, best = 1;
+    unsigned   start [XT_PAR_DEPTH + 1], big [XT_PAR_DEPTH + 1];
+
+    memset (big, 0, sizeof (big));
+    for (l = 0;  l <= XT_PAR_DEPTH;  l++)
+        start [l] = XT_NO_PARENT;
+    for (i = 0;  i <= xt_nextBranch;  i++)
+    {
+        level = (i < xt_nextBranch) ? XT_Level (i) : 0;
+        if (level > XT_PAR_DEPTH)
+            continue;
+        for (l = level;  l <= top;  l++)         /* Subtrees ending here.     */
+            if (start [l] != XT_NO_PARENT && i - start [l] > big [l])
+                big [l] = i - start [l];
+        for (l = level + 1;  l <= top;  l++)
+            start [l] = XT_NO_PARENT;
+        start [level] = i;
+        top = level;
+    }
+
+    for (l = 1;  l < XT_PAR_DEPTH;  l++)
+    {
+        if (big [l] == 0)                        /* Nothing this deep.        */
+            break;
+        if (big [l] <= target)
+            return (l);
+        if (big [l] < big [best])
+            best = l;
+    }
+    return (best);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * A print thread.  Jobs are taken in order, but no further ahead of the last
+ * one written than the pool allows, and each is printed into a buffer of its
+ * own.  The thread's own print state is freed when there are no jobs left.
+ */
+
+__attribute__ ((no_instrument_function))
+void *XT_PrintWorker (void *pArg)
+{
+    unsigned   k;
+    XTPool    *pPool = (XTPool *) pArg;
+
+    for (;;)
+    {
+        pthread_mutex_lock (& pPool->lock);
+        while (pPool->next < pPool->nJobs && pPool->next >= pPool->written + pPool->ahead)
+            pthread_cond_wait (& pPool->cond, & pPool->lock);
+        if (pPool->next >= pPool->nJobs)
+        {
+            pthread_mutex_unlock (& pPool->lock);
+            break;
+        }
+        k = pPool->next++;
+        pthread_mutex_unlock (& pPool->lock);
+
+        XT_PrintJob (pPool, & pPool->pJobs [k]);
+
+        pthread_mutex_lock (& pPool->lock);
+        pPool->pJobs [k].done = 1;
+        pthread_cond_broadcast (& pPool->cond);
+        pthread_mutex_unlock (& pPool->lock);
+    }
+
+#ifdef XT_X_SPILL
+    XT_SpillFreeCache ();
+#endif
+    XT_FREE (xt_pBars);
+    XT_FREE (xt_pLine);
+    xt_pBars = NULL;
+    xt_pLine = NULL;
+    xt_printLevels = 0;
+    return (NULL);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the nodes of a job into a new buffer.  The vertical lines of the
+ * levels above the first node come from its ancestors in the spine.  A spine
+ * node is the last child of its parent if its subtree is followed by a node at
+ * a lower level, and each run of subtrees below the split depth is printed
+ * by a single walk.  pJob->pOut is left NULL if there is not enough memory.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintJob (const XTPool *pPool, XTJob *pJob)
+{
+    unsigned        i, u, k, n, depth, level;
+    int             rootLast;
+    XTNode          node;
+    XTWalk          walk;
+    const XTNode   *pNode;
+    const XTSpine  *pSpine;
+
+    depth = pPool->depth;
+    if (XT_PrintReserve (depth) != 0 ||
+        (xt_pOut = open_memstream (& pJob->pOut, & pJob->len)) == NULL)
+    {
+        pJob->pOut = NULL;
+        return;
+    }
+
+    for (n = 1;  n < XT_Level (pJob->first);  n++)
+    {
+        pSpine = & pPool->pSpine [pJob->anc [n]];
+        xt_pBars [n] = (pSpine->end < xt_nextBranch && XT_Level (pSpine->end) == n) ? 1 : 0;
+    }
+
+    k = pJob->spine;
+    for (i = pJob->first;  i < pJob->end;  )
+    {
+        level = XT_Level (i);
+        if (level < depth)
+        {
+            pSpine = & pPool->pSpine [k++];
+            XT_ReadNode (i, & node);
+            node.last = (pSpine->end < xt_nextBranch && XT_Level (pSpine->end) == level) ? 0 : 1;
+            node.leaf = (pSpine->end == i + 1) ? 1 : 0;
+            XT_ReadTimes (& node, pSpine->end);
+            XT_PrintNode (& node, 0, (pPool->pTotals != NULL) ? & pPool->pTotals [i] : NULL);
+            i++;
+            continue;
+        }
+
+        /* A run of subtrees at the split depth.  Only whether the first has
+         * later siblings needs to be given, the walk works out the rest.
+         */
+        for (u = i + 1;  u < pJob->end && XT_Level (u) > depth;  u++)
+            ;
+        rootLast = (u < xt_nextBranch && XT_Level (u) == depth) ? 0 : 1;
+        while (u < pJob->end && XT_Level (u) >= depth)
+            u++;
+
+        if (XT_WalkInit (& walk, i, u, rootLast) != 0)
+        {
+            fclose (xt_pOut);
+            xt_pOut = NULL;
+            XT_FREE (pJob->pOut);
+            pJob->pOut = NULL;
+            return;
+        }
+        while ((pNode = XT_WalkNext (& walk)) != NULL)
+            XT_PrintNode (pNode, 0, (pPool->pTotals != NULL) ? & pPool->pTotals [pNode->index] : NULL);
+        XT_WalkFree (& walk);
+        i = u;
+    }
+
+    fclose (xt_pOut);
+    xt_pOut = NULL;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Write the buffers described by n iovec entries to fd, continuing after
+ * partial writes.  The entries are changed.  Returns 0 on success or -1 on an
+ * error.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_WriteAll (int fd, struct iovec *pIov, int n)
+{
+    ssize_t   done;
+
+    while (n > 0)
+    {
+        if ((done = writev (fd, pIov, (n < IOV_MAX) ? n : IOV_MAX)) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return (-1);
+        }
+        while (n > 0 && (size_t) done >= pIov->iov_len)
+        {
+            done -= (ssize_t) pIov->iov_len;
+            pIov++;
+            n--;
+        }
+        if (n > 0)
+        {
+            pIov->iov_base = (char *) pIov->iov_base + done;
+            pIov->iov_len -= (size_t) done;
+        }
+    }
+    return (0);
+}
+
+#endif  /* XT_X_THREADS */
+
+
+
+/*-----------------------------------------------------------------------------
+ * Incremental flushing (xt_flushDepth).  A subtree whose root is at the flush
+ * depth or above becomes pending when its root returns.  It can be printed
+ * and its nodes freed once it is known whether the root is the last child of
+ * its parent: it is not if the next function called is at the same level
+ * (XT_FlushEnter), and it is if the parent returns next (XT_FlushExit).
+ * Freeing nodes only means winding the tree back to the subtree's root
+ * (XT_Rewind), since the subtree is always at the end of the tree.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_FlushEnter (unsigned level)
+{
+    if (xt_pending != XT_NO_PARENT && XT_Level (xt_pending) == level)
+        XT_FlushPending (0);
+
+    if (level < XT_FLUSH_MAX && xt_holdClosed [level] != 0)
+    {
+        XT_HoldResolve (level, 0);       /* A later sibling, so not last.   */
+        XT_HoldWrite (0);
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Called in flush mode when the function with node index returns.  If the
+ * function had already been printed because some of its subtrees were flushed,
+ * it is simply removed as these subtrees have all been freed.  Otherwise it is
+ * the root of a complete subtree which becomes pending if it is at the flush
+ * depth or above.  main() at level 0 is never made pending so that anything
+ * left is printed in the normal way.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_FlushExit (unsigned index)
+{
+    unsigned   level;
+
+    level = XT_Level (index);
+
+    if (xt_pending != XT_NO_PARENT && XT_Level (xt_pending) == level + 1)
+        XT_FlushPending (1);          /* Parent returned, so it was last.   */
+
+    if (level + 1 < XT_FLUSH_MAX && xt_holdClosed [level + 1] != 0)
+    {
+        XT_HoldResolve (level + 1, 1);
+        XT_HoldWrite (0);
+    }
+
+    if (level < XT_FLUSH_MAX && xt_printedAt [level] == index + 1)
+    {
+        xt_printedAt [level] = 0;
+        xt_holdClosed [level] = (xt_holdAt [level] != 0) ? 1 : 0;
+        XT_Rewind (index);
+    }
+    else if (level > 0 && level <= (unsigned) xt_flushDepth)
+        xt_pending = index;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the pending subtree and free its nodes.  Any running functions above
+ * it that have not yet been printed are printed first.  As it is not yet known
+ * whether those below main() have later siblings, the lines are printed into
+ * memory and added to the held lines (xt_pHold), and only the lines that no
+ * longer depend on a running function are written out.  If there is not
+ * enough memory for this, everything is written with the running functions
+ * drawn as if they have later siblings.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_FlushPending (int last)
+{
+    unsigned   n, level, index;
+    XTNode     node;
+    char      *pOut = NULL;
+    size_t     len = 0;
+
+    XT_PrintInit ();
+    XT_Demangle ();
+    level = XT_Level (xt_pending);
+
+    if ((level > 1 || xt_holdLen > 0) &&
+        (xt_pOut = open_memstream (& pOut, & len)) == NULL)
+        XT_HoldWrite (1);
+
+    for (n = 0;  n < level;  n++)
+    {
+        index = xt_pOpen [n].index;      /* The running function at level n. */
+        if (xt_printedAt [n] != index + 1)
+        {
+            XT_ReadNode (index, & node);
+            node.last = (n == 0) ? 1 : 0;
+            if (n > 0 && xt_pOut != NULL)
+            {
+                fflush (xt_pOut);
+                xt_holdAt [n] = xt_holdLen + len + 1;
+            }
+            XT_PrintNode (& node, 1, NULL);
+            xt_printedAt [n] = index + 1;
+        }
+    }
+
+    XT_PrintRange (xt_pending, xt_nextBranch, last);
+    XT_Rewind (xt_pending);
+    xt_pending = XT_NO_PARENT;
+
+    if (xt_pOut != NULL)
+    {
+        fclose (xt_pOut);
+        xt_pOut = NULL;
+        XT_HoldAdd (pOut, len);
+        XT_FREE (pOut);
+        XT_HoldWrite (0);
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Add len bytes of lines printed when flushing to the held lines.  If there is
+ * not enough memory, the lines held so far are written, as if the running
+ * functions have later siblings, followed by the new ones.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_HoldAdd (const char *pLines, size_t len)
+{
+    char   *pHold;
+
+    if ((pHold = (char *) XT_REALLOC (xt_pHold, xt_holdLen + len)) == NULL)
+    {
+        XT_HoldWrite (1);
+        XT_HoldPut (pLines, len);
+        return;
+    }
+    xt_pHold = pHold;
+    memcpy (& xt_pHold [xt_holdLen], pLines, len);
+    xt_holdLen += len;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Now that it is known whether the running function printed at level has later
+ * siblings (last is 0 if it does), replace the marks left for it in its held
+ * line and the lines below it.  A mark is XT_HOLD_TEE or XT_HOLD_BAR followed
+ * by ' ' + level, and becomes the tee or 'L' piece on its own line, and the
+ * vertical line or spaces on the others.  The pieces are longer than the
+ * marks, so the lines are moved up from the end.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_HoldResolve (unsigned level, int last)
+{
+    size_t       i, j, at, len, grow = 0;
+    const char  *pPiece;
+    char        *pHold;
+
+    at = xt_holdAt [level] - 1;
+    xt_holdAt [level] = 0;
+    xt_holdClosed [level] = 0;
+
+    for (i = at;  i + 1 < xt_holdLen;  i++)
+        if (XT_HOLD_MARK (& xt_pHold [i], level))
+            grow += strlen (XT_HoldPiece (xt_pHold [i], last)) - 2;
+
+    if ((pHold = (char *) XT_REALLOC (xt_pHold, xt_holdLen + grow)) == NULL)
+    {
+        for (i = 1;  i < XT_FLUSH_MAX;  i++)
+            if (xt_holdAt [i] != 0)
+                XT_HoldGuess ();
+        XT_HoldPut (xt_pHold, xt_holdLen);     /* Write all as not last.  */
+        memset (xt_holdAt, 0, sizeof (xt_holdAt));
+        memset (xt_holdClosed, 0, sizeof (xt_holdClosed));
+        xt_holdLen = 0;
+        return;
+    }
+    xt_pHold = pHold;
+
+    for (i = xt_holdLen, j = xt_holdLen + grow;  i > at; )
+    {
+        i--;
+        if (i > at && XT_HOLD_MARK (& xt_pHold [i - 1], level))
+        {
+            pPiece = XT_HoldPiece (xt_pHold [--i], last);
+            len = strlen (pPiece);
+            j -= len;
+            memcpy (& xt_pHold [j], pPiece, len);
+        }
+        else
+            xt_pHold [--j] = xt_pHold [i];
+    }
+    xt_holdLen += grow;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the piece that replaces the mark c for a function that is (last is
+ * non zero) or is not the last child of its parent.
+ */
+
+__attribute__ ((no_instrument_function))
+const char *XT_HoldPiece (char c, int last)
+{
+    if (c == XT_HOLD_TEE)
+        return ((last != 0) ? xt_LHoriz : xt_teeHoriz);
+    return ((last != 0) ? xt_space : xt_vlinSpace);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Warn, the first time only, that a running function has been drawn as if it
+ * has later siblings before this was known, so the tree may show a line going
+ * on below it that leads nowhere.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_HoldGuess (void)
+{
+    if (xt_holdGuessed != 0)
+        return;
+    xt_holdGuessed = 1;
+    fprintf (stderr, "Too many lines held while flushing.  Running functions drawn as if they have later siblings!\n");
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Write len bytes of held lines, drawing any running function whose marks are
+ * still in them as if it has later siblings.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_HoldPut (const char *pLines, size_t len)
+{
+    size_t   i, from = 0;
+
+    for (i = 0;  i + 1 < len;  i++)
+    {
+        if (pLines [i] == XT_HOLD_TEE || pLines [i] == XT_HOLD_BAR)
+        {
+            fwrite (& pLines [from], 1, i - from, xt_fp);
+            fputs (XT_HoldPiece (pLines [i], 0), xt_fp);
+            from = ++i + 1;
+        }
+    }
+    if (from < len)
+        fwrite (& pLines [from], 1, len - from, xt_fp);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Write out the held lines that no longer depend on a running function, i.e.
+ * those before the line of the first one still held.  While more than
+ * XT_HOLD_MAX bytes are held, or for all of them if all is non zero, the first
+ * running function held is resolved as having later siblings, which is then
+ * how it is drawn (see XT_HoldGuess()).
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_HoldWrite (int all)
+{
+    unsigned   n, first;
+    size_t     end;
+
+    for (;;)
+    {
+        end = xt_holdLen;
+        first = 0;
+        for (n = 1;  n < XT_FLUSH_MAX;  n++)
+        {
+            if (xt_holdAt [n] != 0 && xt_holdAt [n] - 1 < end)
+            {
+                end = xt_holdAt [n] - 1;
+                first = n;
+            }
+        }
+        if (first == 0 || (all == 0 && xt_holdLen <= XT_HOLD_MAX))
+            break;
+        XT_HoldGuess ();
+        XT_HoldResolve (first, 0);
+    }
+    if (end == 0)
+        return;
+
+    fwrite (xt_pHold, 1, end, xt_fp);
+    memmove (xt_pHold, & xt_pHold [end], xt_holdLen - end);
+    xt_holdLen -= end;
+    for (n = 1;  n < XT_FLUSH_MAX;  n++)
+        if (xt_holdAt [n] != 0)
+            xt_holdAt [n] -= end;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the XT_REC_ flags for the data kept with each node besides its time:
+ * the CPU time (XT_TIMER_BOTH), the calls pruned from below it, the counts of
+ * the performance counters and the memory allocated.  The record paths are
+ * built for each set of these (see XT_SelectHooks()).
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_RecordFlags (void)
+{
+    unsigned   flags = 0;
+
+    if (xt_timer == XT_TIMER_BOTH)
+        flags |= XT_REC_CPU;
+    if (xt_pruneTicks != 0 || xt_pPruned != NULL)
+        flags |= XT_REC_PRUNE;
+    if (xt_counters == 1)
+        flags |= XT_REC_COUNTERS;
+    if (xt_allocs == 1)
+        flags |= XT_REC_ALLOCS;
+    return (flags);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This function is called to add the current function as the next node of the
+ * function call trace tree.  The level of the node is stored in xt_pLevel and
+ * its enter record (name id and, when timing, the ticks since the previous
+ * event) is appended to the stream.  The line number that the function was
+ * called from (usually 0 as this info is difficult to get) is kept separately.
+ * As more function calls are added, the memory is automatically expanded.
+ * For a span, pId points to the name id kept at its call site, so its name is
+ * only looked up the first time.  It is NULL for functions.
+ * The node is added by XT_AddNode(), which the record paths also use with a
+ * constant timer and flags (see XT_EnterNode()), so that the data not kept
+ * costs nothing.  When building the tree of samples, the time is the clock
+ * kept by XT_SampleTree().  If the data kept has to change as an array could
+ * not be expanded, the node is added again with the options left.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_AddBranch (const char *p, unsigned *pId, unsigned level)
+{
+    XT_AddNode (p, pId, level, xt_timer, XT_RecordFlags ());
+}
+
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_AddNode (const char *p, unsigned *pId, unsigned level, XTTimer timer, unsigned flags)
+{
+    unsigned            index, id;
+    unsigned long long  now;
+    XTOpen             *pOpen;
+    int                 rtn;
+
+    if ((rtn = XT_TreeReserve (level)) != 0)
+    {
+        if (rtn > 0)
+            XT_AddBranch (p, pId, level);
+        return;
+    }
+
+    index = xt_nextBranch;
+    if (index % XT_CHECK_NODES == 0)
+    {
+        xt_pCheck [index / XT_CHECK_NODES].offset = xt_dataUsed;
+        xt_pCheck [index / XT_CHECK_NODES].tick = xt_lastTick;
+    }
+
+    pOpen = & xt_pOpen [level];          /* Now the running node at level.  */
+    pOpen->index = index;
+    pOpen->offset = xt_dataUsed;
+    pOpen->tick = xt_lastTick;
+
+    id = (pId != NULL) ? __atomic_load_n (pId, __ATOMIC_RELAXED) : 0;
+    if (id == 0 && (id = XT_AddFunctionName (p)) == 0)
+    {
+        XT_Disable ();
+        fprintf (stderr, "Not enough memory for the call tree.  Tracing disabled!\n");
+        return;
+    }
+    if (pId != NULL)
+        __atomic_store_n (pId, id, __ATOMIC_RELAXED);
+    id--;                                /* Name id.                        */
+    xt_dataUsed += XT_PutVar (& xt_pData [xt_dataUsed - xt_dataBase], id);
+    if (timer != XT_TIMER_DISABLED)
+    {
+        now = XT_NOW (timer);            /* Store the current time.         */
+        xt_dataUsed += XT_PutVar (& xt_pData [xt_dataUsed - xt_dataBase], now - xt_lastTick);
+        xt_lastTick = now;
+    }
+
+    xt_pLevel [index - xt_levelBase] = (uint16_t) level;
+    if (xt_lineNo != 0)
+        XT_SetLine (index, xt_lineNo);
+    xt_exitNodeIndex = index;
+
+    /* Store the counts on entry, these are replaced by the counts used
+     * by the call when it exits.
+     */
+    if ((flags & XT_REC_COUNTERS) != 0)
+        XT_ReadCounters (& xt_pCounts [index * xt_nCounters]);
+
+    if ((flags & XT_REC_CPU) != 0)
+        xt_pCpu [index] = XT_GetCpuTicks ();
+
+    if ((flags & XT_REC_ALLOCS) != 0)
+        memset (& xt_pAllocs [index], 0, sizeof (XTAlloc));
+
+    if ((flags & XT_REC_PRUNE) != 0 && index < xt_prunedSize)
+        memset (& xt_pPruned [index], 0, sizeof (XTPrune));
+
+    xt_nextBranch++;                     /* Update index to next node.      */
+    xt_lineNo = 0;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Record the return of the running function at level, the node xt_exitNodeIndex.
+ * Its exit record (when timing, the ticks since the previous event) is appended
+ * to the stream, the counters used by the call are stored and the function
+ * that called it becomes the node where the next exit is recorded.  A short
+ * call may instead be pruned (see XT_Prune()), leaving no node at all.  As
+ * with XT_AddBranch(), the work is done by XT_CloseNode().
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_CloseBranch (unsigned level)
+{
+    XT_CloseNode (level, xt_timer, XT_RecordFlags ());
+}
+
+
+static inline __attribute__ ((always_inline, no_instrument_function))
+void XT_CloseNode (unsigned level, XTTimer timer, unsigned flags)
+{
+    unsigned            i, index;
+    unsigned long long  now, cpu = 0, counts [XT_COUNTERS], *pCounts;
+
+    if ((flags & XT_REC_COUNTERS) != 0)
+        XT_ReadCounters (counts);
+    if ((flags & XT_REC_CPU) != 0)
+        cpu = XT_GetCpuTicks ();
+
+    if (timer != XT_TIMER_DISABLED)
+    {
+        now = XT_NOW (timer);
+        if ((flags & XT_REC_PRUNE) != 0 && XT_Prune (xt_exitNodeIndex, level, now) == 1)
+            return;
+        if (xt_dataSize - (xt_dataUsed - xt_dataBase) < XT_VAR_MAX && XT_TreeReserve (0) < 0)
+            return;
+        xt_dataUsed += XT_PutVar (& xt_pData [xt_dataUsed - xt_dataBase], now - xt_lastTick);
+        xt_lastTick = now;
+    }
+
+    index = xt_exitNodeIndex;
+    if ((flags & XT_REC_COUNTERS) != 0)    /* Counts used by call.  */
+    {
+        pCounts = & xt_pCounts [index * xt_nCounters];
+        for (i = 0;  i < xt_nCounters;  i++)
+            pCounts [i] = counts [i] - pCounts [i];
+    }
+    if ((flags & XT_REC_CPU) != 0)         /* CPU time used by call.  */
+        xt_pCpu [index] = cpu - xt_pCpu [index];
+    xt_exitNodeIndex = (level > 0) ? xt_pOpen [level - 1].index : 0;
+
+    if (xt_lineNo != 0)
+        XT_SetLine (index, xt_lineNo);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Prune the call at index, returning at time now, if it is shorter than
+ * xt_pruneTicks and has no children.  Such a node is always the last one, so
+ * it is removed by winding the tree back to it (XT_Rewind), which also winds
+ * the time of the last event back to before it, so its time becomes part of
+ * its parent's.  The call, along with any calls pruned from below it, is
+ * counted against the parent, and any allocations it made are charged to the
+ * parent.  main(), functions already printed when flushing and nodes that
+ * have been spilled to disk, even in part, are never pruned.  Returns 1 if the
+ * node was pruned, otherwise 0.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_Prune (unsigned index, unsigned level, unsigned long long now)
+{
+    unsigned            parent;
+    size_t              pos;
+    unsigned long long  enter;
+    XTPrune            *pPrune;
+
+    if (level == 0 || index + 1 != xt_nextBranch || index >= xt_prunedSize ||
+        (level < XT_FLUSH_MAX && xt_printedAt [level] == index + 1) ||
+        index < xt_levelBase || xt_pOpen [level].offset < xt_dataBase)
+        return (0);
+
+    pos = xt_pOpen [level].offset;       /* Skip the name id to the time.   */
+    XT_GetVar (& pos);
+    enter = xt_pOpen [level].tick + XT_GetVar (& pos);
+    if (now - enter >= xt_pruneTicks)
+        return (0);
+
+    parent = xt_pOpen [level - 1].index;
+    pPrune = & xt_pPruned [parent];
+    pPrune->calls += 1 + xt_pPruned [index].calls;
+    pPrune->ticks += now - enter;
+
+    if (xt_allocs == 1)
+    {
+        xt_pAllocs [parent].bytes += xt_pAllocs [index].bytes;
+        xt_pAllocs [parent].count += xt_pAllocs [index].count;
+        xt_pAllocs [parent].freed += xt_pAllocs [index].freed;
+    }
+
+    XT_Rewind (index);
+    xt_exitNodeIndex = parent;
+    return (1);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Make sure there is room in the tree for one more node at level, along with
+ * its enter record and any exits before the next node.  The arrays are
+ * doubled in size as needed, so the cost of growing them stays in proportion
+ * to the number of calls, unless the tree has reached the memory budget when
+ * the stream and levels are spilled to disk instead.  The counter, allocation
+ * and pruning arrays always have room for as many nodes as the checkpoints.
+ * If one cannot be expanded, it stops being used rather than losing the tree,
+ * and the hook paths are chosen again without it.  If the tree itself cannot
+ * be expanded, tracing is disabled.  Returns 0 on success, 1 if there is room
+ * but an array stopped being used, or -1 on failure.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_TreeReserve (unsigned level)
+{
+    unsigned             n, dropped = 0;
+    size_t               size, spilled = 0;
+    void                *p;
+
+    if (xt_nextBranch >= xt_treeSize)
+    {
+        n = (xt_treeSize == 0) ? 4096 : xt_treeSize * 2;
+        if ((p = XT_REALLOC (xt_pCheck, (size_t) (n / XT_CHECK_NODES + 1) * sizeof (XTCheck))) == NULL)
+            goto fail;
+        xt_pCheck = (XTCheck *) p;
+        xt_treeSize = n;
+
+        if (xt_counters == 1)
+        {
+            p = XT_REALLOC (xt_pCounts, (size_t) n * xt_nCounters * sizeof (unsigned long long));
+            if (p != NULL)
+            {
+                xt_pCounts = (unsigned long long *) p;
+                xt_countsSize = n;
+            }
+            else
+            {
+                xt_counters = 0;
+                dropped = 1;
+            }
+        }
+
+        if (xt_timer == XT_TIMER_BOTH)
+        {
+            if ((p = XT_REALLOC (xt_pCpu, (size_t) n * sizeof (unsigned long long))) != NULL)
+            {
+                xt_pCpu = (unsigned long long *) p;
+                xt_cpuSize = n;
+            }
+            else
+            {
+                xt_timer = XT_TIMER_ELAPSED;
+                dropped = 1;
+            }
+        }
+
+        if (xt_allocs == 1)
+        {
+            if ((p = XT_REALLOC (xt_pAllocs, (size_t) n * sizeof (XTAlloc))) != NULL)
+            {
+                xt_pAllocs = (XTAlloc *) p;
+                xt_allocsSize = n;
+            }
+            else
+            {
+                xt_allocs = 0;
+                dropped = 1;
+            }
+        }
+
+        if (xt_pruneTicks != 0)
+        {
+            if ((p = XT_REALLOC (xt_pPruned, (size_t) n * sizeof (XTPrune))) != NULL)
+            {
+                xt_pPruned = (XTPrune *) p;
+                xt_prunedSize = n;
+            }
+            else
+            {
+                xt_pruneTicks = 0;
+                dropped = 1;
+            }
+        }
+    }
+
+    if (xt_nextBranch - xt_levelBase >= xt_levelsSize)
+    {
+        n = (xt_levelsSize == 0) ? 4096 : xt_levelsSize * 2;
+#ifdef XT_X_SPILL
+        spilled = XT_Spill (& xt_levelSpill, (unsigned char *) xt_pLevel,
+                            (size_t) xt_levelsSize * sizeof (uint16_t),
+                            (size_t) (n - xt_levelsSize) * sizeof (uint16_t));
+        xt_levelBase += (unsigned) (spilled / sizeof (uint16_t));
+#endif
+        if (spilled == 0)
+        {
+            if ((p = XT_REALLOC (xt_pLevel, (size_t) n * sizeof (uint16_t))) == NULL)
+                goto fail;
+            xt_pLevel = (uint16_t *) p;
+            xt_levelsSize = n;
+        }
+    }
+
+    if (xt_dataSize - (xt_dataUsed - xt_dataBase) < 4 * XT_VAR_MAX)
+    {
+        size = (xt_dataSize == 0) ? 65536 : xt_dataSize * 2;
+#ifdef XT_X_SPILL
+        spilled = XT_Spill (& xt_dataSpill, xt_pData, xt_dataUsed - xt_dataBase,
+                            size - xt_dataSize);
+        xt_dataBase += spilled;
+#endif
+        if (spilled == 0)
+        {
+            if ((p = XT_REALLOC (xt_pData, size)) == NULL)
+                goto fail;
+            xt_pData = (unsigned char *) p;
+            xt_dataSize = size;
+        }
+    }
+
+    if (level >= xt_openSize)
+    {
+        n = (level + 64) & ~31u;
+        if ((p = XT_REALLOC (xt_pOpen, (size_t) n * sizeof (XTOpen))) == NULL)
+            goto fail;
+        xt_pOpen = (XTOpen *) p;
+        xt_openSize = n;
+    }
+
+    if (dropped == 1)                    /* Choose paths without it.        */
+    {
+        XT_SelectHooks ();
+        return (1);
+    }
+    return (0);
+
+fail:
+    XT_Disable ();
+    fprintf (stderr, "Not enough memory for the call tree.  Tracing disabled!\n");
+    return (-1);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the index in xt_funcNames of the name printed for name id.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_NameIndex (unsigned id)
+{
+    return ((id < xt_nShown) ? xt_pShowAt [id] : xt_pNameAt [id]);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Work out the printed form of every name added since the last call, which is
+ * made before anything is printed or saved.  Demangled names are added to the
+ * name buffer like any other, and xt_pShowAt gives the index of the printed
+ * form of each id, so each symbol is only ever demangled once.  Nothing is
+ * done when the program does not include the C++ runtime.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Demangle (void)
+{
+    unsigned   id, n, rtn;
+    char      *pName;
+    unsigned  *pShowAt;
+
+    if (__cxa_demangle == NULL || xt_nShown >= xt_nNames)
+        return;
+
+    n = xt_nNames;                       /* Names added here are printed as  */
+    for (id = xt_nShown;  id < n;  id++) /* they are, so need no entry.      */
+    {
+        if ((pName = XT_DemangleName (& xt_funcNames [xt_pNameAt [id]])) == NULL)
+            continue;
+        rtn = XT_AddFunctionName (pName);
+        XT_FREE (pName);
+        if (rtn == 0)
+            break;
+
+        pShowAt = (unsigned *) XT_REALLOC (xt_pShowAt, (size_t) (id + 1) * sizeof (unsigned));
+        if (pShowAt == NULL)
+            break;
+        xt_pShowAt = pShowAt;
+        while (xt_nShown < id)                 /* Names shown unchanged.    */
+        {
+            xt_pShowAt [xt_nShown] = xt_pNameAt [xt_nShown];
+            xt_nShown++;
+        }
+        xt_pShowAt [xt_nShown++] = xt_pNameAt [rtn - 1];
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Demangle a C++ symbol name, eliding the template arguments if requested.
+ * Only names starting with _Z are demangled, as __cxa_demangle() would also
+ * turn plain C names such as "f" into type names.  Returns the new name,
+ * which the caller must free, or NULL if the name is left as it is.
+ */
+
+__attribute__ ((no_instrument_function))
+char *XT_DemangleName (const char *pName)
+{
+    int     status;
+    char   *pOut;
+
+    if (__cxa_demangle == NULL || strncmp (pName, "_Z", 2) != 0)
+        return (NULL);
+
+    if ((pOut = __cxa_demangle (pName, NULL, NULL, & status)) == NULL || status != 0)
+        return (NULL);
+
+    if (xt_elideTemplates == 1)
+        XT_ElideTemplates (pOut);
+    return (pOut);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Remove the template arguments from a demangled name in place, leaving just
+ * the angle brackets.  The '<' of operator<, operator<< etc. is not the start
+ * of an argument list, and brackets within parentheses inside an argument list
+ * (e.g. in expressions) are ignored.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ElideTemplates (char *pName)
+{
+    char      *pIn, *pOut;
+    unsigned   depth = 0, parens = 0;
+
+    for (pIn = pOut = pName;  *pIn != '\0';  pIn++)
+    {
+        if (depth == 0)
+        {
+            /* The name written so far is tested, as the input before pIn
+             * may have been overwritten.
+             */
+            if (*pIn == '<' && pOut - pName >= 8 && strncmp (pOut - 8, "operator", 8) == 0)
+            {
+                *pOut++ = '<';                 /* operator<                 */
+                if (pIn [1] == '<' || pIn [1] == '=')
+                    *pOut++ = *++pIn;          /* operator<< or operator<=  */
+                if (*pIn == '=' && pIn [1] == '>')
+                    *pOut++ = *++pIn;          /* operator<=>               */
+                continue;
+            }
+            *pOut++ = *pIn;
+            if (*pIn == '<')
+                depth = 1;
+        }
+        else if (*pIn == '(')
+            parens++;
+        else if (*pIn == ')' && parens > 0)
+            parens--;
+        else if (parens == 0 && *pIn == '<')
+            depth++;
+        else if (parens == 0 && *pIn == '>' && --depth == 0)
+            *pOut++ = '>';
+    }
+    *pOut = '\0';
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Record the line number of a node.  Line numbers are kept sorted by node
+ * index.  The node is normally the last one, or is the function returning, in
+ * which case only the line numbers of the functions it called can follow it.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SetLine (unsigned index, int lineNo)
+{
+    unsigned   n, size;
+    XTLine    *pLines;
+
+    for (n = xt_nLines;  n > 0 && xt_pLines [n - 1].index > index;  n--)
+        ;
+    if (n > 0 && xt_pLines [n - 1].index == index)
+    {
+        xt_pLines [n - 1].lineNo = lineNo;
+        return;
+    }
+
+    if (xt_nLines >= xt_linesSize)
+    {
+        size = (xt_linesSize == 0) ? 256 : xt_linesSize * 2;
+        if ((pLines = (XTLine *) XT_REALLOC (xt_pLines, (size_t) size * sizeof (XTLine))) == NULL)
+            return;
+        xt_pLines = pLines;
+        xt_linesSize = size;
+    }
+    memmove (& xt_pLines [n + 1], & xt_pLines [n], (size_t) (xt_nLines - n) * sizeof (XTLine));
+    xt_pLines [n].index = index;
+    xt_pLines [n].lineNo = lineNo;
+    xt_nLines++;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Discard node index and every node after it, which must be the most recent
+ * subtree, with its root either running or just returned.  The stream is
+ * wound back to the root's enter record and the time of the last event to the
+ * time before it, so that later events are recorded against the same clock.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Rewind (unsigned index)
+{
+    XTOpen    *pOpen;
+
+    pOpen = & xt_pOpen [XT_Level (index)];
+    xt_nextBranch = index;
+    xt_dataUsed = pOpen->offset;         /* Never before xt_dataBase.       */
+    xt_lastTick = pOpen->tick;
+
+    while (xt_nLines > 0 && xt_pLines [xt_nLines - 1].index >= index)
+        xt_nLines--;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Varints.  XT_PutVar() writes value at p and returns the number of bytes
+ * used (1 to XT_VAR_MAX).  XT_GetVar() reads the value at stream offset *pPos
+ * and XT_BackVar() reads the value ending at offset *pPos; both leave *pPos at
+ * the other end of the value.  Reading backwards works because only the last
+ * byte of a varint has the top bit clear.  Bytes before xt_dataBase are read
+ * back from disk.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_PutVar (unsigned char *p, unsigned long long value)
+{
+    unsigned   n = 0;
+
+    while (value >= 0x80)
+    {
+        p [n++] = (unsigned char) (value | 0x80);
+        value >>= 7;
+    }
+    p [n++] = (unsigned char) value;
+    return (n);
+}
+
+
+__attribute__ ((no_instrument_function))
+unsigned long long XT_GetVar (size_t *pPos)
+{
+    unsigned            c, shift = 0;
+    unsigned long long  value = 0;
+    size_t              pos = *pPos;
+
+    do
+    {
+        c = XT_DataByte (pos++);
+        value |= (unsigned long long) (c & 0x7f) << shift;
+        shift += 7;
+    }
+    while (c & 0x80);
+
+    *pPos = pos;
+    return (value);
+}
+
+
+__attribute__ ((no_instrument_function))
+unsigned long long XT_BackVar (size_t *pPos)
+{
+    size_t    pos;
+
+    for (pos = *pPos - 1;  pos > 0 && (XT_DataByte (pos - 1) & 0x80) != 0;  pos--)
+        ;
+    *pPos = pos;
+    return (XT_GetVar (& pos));
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the byte at stream offset pos, or the level of node index, reading it
+ * back from disk if it is before xt_dataBase or xt_levelBase.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_DataByte (size_t pos)
+{
+#ifdef XT_X_SPILL
+    if (pos < xt_dataBase)
+        return (*XT_SpillRead (& xt_dataSpill, pos));
+#endif
+    return (xt_pData [pos - xt_dataBase]);
+}
+
+
+__attribute__ ((no_instrument_function))
+unsigned XT_Level (unsigned index)
+{
+#ifdef XT_X_SPILL
+    uint16_t   level;
+
+    if (index < xt_levelBase)
+    {
+        memcpy (& level, XT_SpillRead (& xt_levelSpill, (size_t) index * sizeof (uint16_t)),
+                sizeof (uint16_t));
+        return (level);
+    }
+#endif
+    return (xt_pLevel [index - xt_levelBase]);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Find the stream offset of the enter record of node index (which must exist)
+ * and the time of the event before it, starting from the checkpoint before the
+ * node.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Seek (unsigned index, size_t *pPos, unsigned long long *pTick)
+{
+    unsigned            i, n;
+    size_t              pos;
+    unsigned long long  tick;
+
+    i = index - index % XT_CHECK_NODES;
+    pos = xt_pCheck [i / XT_CHECK_NODES].offset;
+    tick = xt_pCheck [i / XT_CHECK_NODES].tick;
+
+    for (;  i < index;  i++)
+    {
+        XT_GetVar (& pos);                    /* Name id.         */
+        if (xt_timer == XT_TIMER_DISABLED)
+            continue;
+        for (n = (unsigned) XT_Level (i) + 2 - XT_Level (i + 1);  n > 0;  n--)
+            tick += XT_GetVar (& pos);        /* Enter and exits. */
+    }
+    *pPos = pos;
+    *pTick = tick;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Decode the name, level and line number of a single node, e.g. one that is
+ * still running.  The times, last and leaf are not filled in.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ReadNode (unsigned index, XTNode *pNode)
+{
+    unsigned            n;
+    size_t              pos;
+    unsigned long long  tick;
+
+    memset (pNode, 0, sizeof (XTNode));
+    XT_Seek (index, & pos, & tick);
+    pNode->index = index;
+    pNode->level = XT_Level (index);
+    pNode->nameIndx = XT_NameIndex ((unsigned) XT_GetVar (& pos));
+    for (n = xt_nLines;  n > 0 && xt_pLines [n - 1].index > index;  n--)
+        ;
+    if (n > 0 && xt_pLines [n - 1].index == index)
+        pNode->lineNo = xt_pLines [n - 1].lineNo;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Fill in the enter and exit times of a node read by XT_ReadNode() whose
+ * subtree ends before node end (which may be xt_nextBranch), without decoding
+ * the subtree.  The exit records between the last node of the subtree and
+ * node end are those of the levels from the deepest down to the level of node
+ * end, so the node's own exit is found by stepping back over the exits of the
+ * levels below it.  The function must have returned.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ReadTimes (XTNode *pNode, unsigned end)
+{
+    unsigned            n;
+    size_t              pos;
+    unsigned long long  tick;
+
+    if (xt_timer == XT_TIMER_DISABLED)
+        return;
+
+    XT_Seek (pNode->index, & pos, & tick);
+    XT_GetVar (& pos);                        /* Name id.         */
+    pNode->enterTime = tick + XT_GetVar (& pos);
+
+    if (end < xt_nextBranch)
+    {
+        XT_Seek (end, & pos, & tick);
+        n = pNode->level - XT_Level (end);
+    }
+    else
+    {
+        pos = xt_dataUsed;
+        tick = xt_lastTick;
+        n = (xt_level < pNode->level) ? pNode->level - xt_level : 0;
+    }
+    for (;  n > 0;  n--)
+        tick -= XT_BackVar (& pos);
+    pNode->exitTime = tick;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Walking the tree.  The nodes first to end - 1, which must be one or more
+ * complete subtrees, are returned in order by XT_WalkNext() as fully decoded
+ * XTNode entries.  A node's exit time and whether it has later siblings are
+ * only found after its whole subtree, so the range is decoded backwards, when
+ * both are known by the time the node is reached.  To avoid decoding the whole
+ * range into memory, this is done a window of XT_WINDOW nodes at a time: a
+ * first backward pass (XT_WalkInit) saves the state at the end of each window,
+ * and each window is decoded again from this state when it is needed.  The
+ * state is the stream position and time (XTSnap), and for each level the exit
+ * time of the node open there and whether a later sibling has been seen.
+ * Returns 0 on success or -1 if out of memory.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_WalkInit (XTWalk *pWalk, unsigned first, unsigned end, int rootLast)
+{
+    unsigned   i, n, w, level, maxLevel = 0;
+
+    memset (pWalk, 0, sizeof (XTWalk));
+    pWalk->first = first;
+    pWalk->end = end;
+    pWalk->rootLast = rootLast;
+    if (first >= end)
+        return (0);
+
+    for (i = first;  i < end;  i++)
+        if (XT_Level (i) > maxLevel)
+            maxLevel = XT_Level (i);
+    pWalk->nLevels = maxLevel + 2;
+    pWalk->nWindows = (end - first + XT_WINDOW - 1) / XT_WINDOW;
+    pWalk->window = XT_NO_PARENT;
+
+    n = pWalk->nLevels;
+    pWalk->pExit = (unsigned long long *) XT_CALLOC (n, sizeof (unsigned long long));
+    pWalk->pSeen = (unsigned char *) XT_CALLOC (n, 1);
+    pWalk->pSnap = (XTSnap *) XT_CALLOC (pWalk->nWindows, sizeof (XTSnap));
+    pWalk->pSnapExit = (unsigned long long *) XT_CALLOC ((size_t) pWalk->nWindows * n,
+                                                         sizeof (unsigned long long));
+    pWalk->pSnapSeen = (unsigned char *) XT_CALLOC ((size_t) pWalk->nWindows * n, 1);
+    pWalk->pNodes = (XTNode *) XT_CALLOC (XT_WINDOW, sizeof (XTNode));
+    if (pWalk->pExit == NULL || pWalk->pSeen == NULL || pWalk->pSnap == NULL ||
+        pWalk->pSnapExit == NULL || pWalk->pSnapSeen == NULL || pWalk->pNodes == NULL)
+    {
+        XT_WalkFree (pWalk);
+        return (-1);
+    }
+
+    /* The state at the end of the range.  The exits after the last node are
+     * those of the functions that have returned since it was called.
+     */
+    level = XT_Level (end - 1);
+    if (end < xt_nextBranch)
+    {
+        XT_Seek (end, & pWalk->at.pos, & pWalk->at.tick);
+        pWalk->at.nExit = level + 1 - XT_Level (end);
+        pWalk->pSeen [XT_Level (end)] = 1;  /* Node end has been seen.      */
+        pWalk->at.seenTop = XT_Level (end);
+    }
+    else
+    {
+        pWalk->at.pos = xt_dataUsed;
+        pWalk->at.tick = xt_lastTick;
+        pWalk->at.nExit = level + 1 - ((xt_level < level + 1) ? xt_level : level + 1);
+    }
+
+    for (w = pWalk->nWindows;  w-- > 0;  )
+    {
+        pWalk->pSnap [w] = pWalk->at;
+        memcpy (& pWalk->pSnapExit [(size_t) w * n], pWalk->pExit, n * sizeof (unsigned long long));
+        memcpy (& pWalk->pSnapSeen [(size_t) w * n], pWalk->pSeen, n);
+
+        if (w == 0)
+            break;
+        i = first + w * XT_WINDOW + XT_WINDOW;
+        for (i = (i < end) ? i : end;  i-- > first + w * XT_WINDOW;  )
+            XT_WalkBack (pWalk, i, NULL);
+    }
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the next node of the walk, or NULL when there are no more.  When the
+ * current window is used up, the next is decoded backwards from the state
+ * saved for its end.
+ */
+
+__attribute__ ((no_instrument_function))
+const XTNode *XT_WalkNext (XTWalk *pWalk)
+{
+    unsigned        i, n, start;
+    XTNode         *pNode;
+
+    if (pWalk->next >= pWalk->count)
+    {
+        pWalk->window = (pWalk->window == XT_NO_PARENT) ? 0 : pWalk->window + 1;
+        if (pWalk->window >= pWalk->nWindows)
+            return (NULL);
+
+        n = pWalk->nLevels;
+        pWalk->at = pWalk->pSnap [pWalk->window];
+        memcpy (pWalk->pExit, & pWalk->pSnapExit [(size_t) pWalk->window * n], n * sizeof (unsigned long long));
+        memcpy (pWalk->pSeen, & pWalk->pSnapSeen [(size_t) pWalk->window * n], n);
+
+        start = pWalk->first + pWalk->window * XT_WINDOW;
+        pWalk->count = pWalk->end - start;
+        if (pWalk->count > XT_WINDOW)
+            pWalk->count = XT_WINDOW;
+        for (i = pWalk->count;  i-- > 0;  )
+            XT_WalkBack (pWalk, start + i, & pWalk->pNodes [i]);
+        pWalk->next = 0;
+
+        /* Find the first line number at or after the window.
+         */
+        if (pWalk->window == 0)
+            for (pWalk->line = 0;  pWalk->line < xt_nLines && xt_pLines [pWalk->line].index < start; )
+                pWalk->line++;
+    }
+
+    pNode = & pWalk->pNodes [pWalk->next++];
+    while (pWalk->line < xt_nLines && xt_pLines [pWalk->line].index < pNode->index)
+        pWalk->line++;
+    if (pWalk->line < xt_nLines && xt_pLines [pWalk->line].index == pNode->index)
+        pNode->lineNo = xt_pLines [pWalk->line].lineNo;
+    return (pNode);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Step the walk back over node index, from the boundary after it to the start
+ * of its enter record.  The exits read on the way are those of the nodes at
+ * the levels from the node's own level down to the level of the next node.
+ * When pNode is not NULL the decoded node is stored there.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_WalkBack (XTWalk *pWalk, unsigned index, XTNode *pNode)
+{
+    unsigned            n, level, id;
+    int                 last;
+    unsigned long long  enter;
+
+    level = XT_Level (index);
+    for (n = level + 1 - pWalk->at.nExit;  n <= level;  n++)
+    {
+        pWalk->pExit [n] = pWalk->at.tick;
+        if (xt_timer != XT_TIMER_DISABLED)
+            pWalk->at.tick -= XT_BackVar (& pWalk->at.pos);
+    }
+
+    enter = pWalk->at.tick;
+    if (xt_timer != XT_TIMER_DISABLED)
+        pWalk->at.tick -= XT_BackVar (& pWalk->at.pos);
+    id = (unsigned) XT_BackVar (& pWalk->at.pos);
+
+    /* The node is the last child of its parent if no node at the same level
+     * has been seen since the last one at a lower level.
+     */
+    if (index == pWalk->first)
+        last = pWalk->rootLast;
+    else
+        last = (level == 0 || pWalk->pSeen [level] == 0) ? 1 : 0;
+    pWalk->pSeen [level] = 1;
+    for (n = level + 1;  n <= pWalk->at.seenTop;  n++)
+        pWalk->pSeen [n] = 0;
+    pWalk->at.seenTop = level;
+
+    pWalk->at.nExit = (index > 0) ? XT_Level (index - 1) + 1 - level : 0;
+
+    if (pNode != NULL)
+    {
+        pNode->index = index;
+        pNode->level = level;
+        pNode->nameIndx = XT_NameIndex (id);
+        pNode->lineNo = 0;
+        pNode->last = last;
+        pNode->leaf = (index + 1 >= xt_nextBranch || XT_Level (index + 1) <= level) ? 1 : 0;
+        pNode->enterTime = enter;
+        pNode->exitTime = pWalk->pExit [level];
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Release the memory used by a walk.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_WalkFree (XTWalk *pWalk)
+{
+    XT_FREE (pWalk->pExit);
+    XT_FREE (pWalk->pSeen);
+    XT_FREE (pWalk->pSnap);
+    XT_FREE (pWalk->pSnapExit);
+    XT_FREE (pWalk->pSnapSeen);
+    XT_FREE (pWalk->pNodes);
+    pWalk->pExit = NULL;
+    pWalk->pSeen = NULL;
+    pWalk->pSnap = NULL;
+    pWalk->pSnapExit = NULL;
+    pWalk->pSnapSeen = NULL;
+    pWalk->pNodes = NULL;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * null terminated function names are stored in along character buffer one
+ * after the other.  As memory requirements grow, the buffer is resized
+ * automatically.  Since resizing does not guarantee the buffer will not be
+ * moved, rather than storing pointers to the required string, each name is
+ * given an id and xt_pNameAt[id] holds the offset to the name from the start
+ * of the buffer.  Each name is only stored the first time it is seen; after
+ * that the id of the copy already in the buffer is returned.
+ * NOTE the returned value is 1 more than the id, so needs to be decremented
+ * to use it.  If an error occurs, zero is returned.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_AddFunctionName (const char *p)
+{
+    unsigned  len, rtn, h, i, n, size, *pHash, *pAt;
+
+    for (h = 5381, len = 0;  p [len] != '\0';  len++)    /* Hash the name.   */
+        h = h * 33 + (unsigned char) p [len];
+    len++;                           /* Symbol name length including null.  */
+
+    if (xt_pNameHash != NULL)        /* Already stored?                     */
+    {
+        for (i = h & (xt_nameHashSize - 1);  (rtn = xt_pNameHash [i]) != 0;
+             i = (i + 1) & (xt_nameHashSize - 1))
+            if (strcmp (& xt_funcNames [xt_pNameAt [rtn - 1]], p) == 0)
+                return (rtn);
+    }
+
+    if (xt_nNames * 2 >= xt_nameHashSize)                /* Grow the hash   */
+    {                                                    /* table.          */
+        size = (xt_nameHashSize == 0) ? 1024 : xt_nameHashSize * 2;
+        if ((pHash = (unsigned *) XT_CALLOC ((size_t) size, sizeof (unsigned))) == NULL)
+            return (0);
+        if ((pAt = (unsigned *) XT_REALLOC (xt_pNameAt, (size_t) size / 2 * sizeof (unsigned))) == NULL)
+        {
+            XT_FREE (pHash);
+            return (0);
+        }
+        xt_pNameAt = pAt;
+        for (n = 0;  n < xt_nameHashSize;  n++)
+        {
+            if ((rtn = xt_pNameHash [n]) == 0)
+                continue;
+            for (h = 5381, i = xt_pNameAt [rtn - 1];  xt_funcNames [i] != '\0';  i++)
+                h = h * 33 + (unsigned char) xt_funcNames [i];
+            for (i = h & (size - 1);  pHash [i] != 0;  i = (i + 1) & (size - 1))
+                ;
+            pHash [i] = rtn;
+        }
+        XT_FREE (xt_pNameHash);
+        xt_pNameHash = pHash;
+        xt_nameHashSize = size;
+        return (XT_AddFunctionName (p));
+    }
+
+    if (xt_funcNames == NULL)        /* If NULL, no mem allocated yet.      */
+    {
+        xt_nameBuffSize = 10000;     /* Initial buffer size.                */
+        xt_funcNames = (char *) XT_CALLOC (xt_nameBuffSize, sizeof (char));
+        xt_nextAvail = 0;            /* Init index to next avail slot.      */
+    }
+    else if (xt_nameBuffSize - xt_nextAvail <= len)      /* Enough room for */
+    {                                                    /* next symbol?    */
+        xt_nameBuffSize += 5000 + len;  /* Expanded buffer size.            */
+        xt_funcNames = (char *) XT_REALLOC (xt_funcNames, xt_nameBuffSize);
+    }
+
+    if (xt_funcNames != NULL)
+    {
+        strncpy (& xt_funcNames [xt_nextAvail], p, len);  /* Copy to buffer */
+        xt_pNameAt [xt_nNames] = xt_nextAvail;  /* Save index of symbol.    */
+        xt_nextAvail += len;        /* Update next avail slot index.        */
+        rtn = ++xt_nNames;          /* Id of the symbol just saved (+1).    */
+
+        for (i = h & (xt_nameHashSize - 1);  xt_pNameHash [i] != 0;
+             i = (i + 1) & (xt_nameHashSize - 1))
+            ;
+        xt_pNameHash [i] = rtn;
+        return (rtn);               /* Return id of current symbol.         */
+    }
+    return (0);                     /* Error.  Symbol not saved.            */
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * When pretty printing, lines are drawn using box characters. These characters
+ * are defined in the unicode character set \u2500 to \u257f.  The characters
+ * used are the vertical line (\u2502 or │), horizontal line (\u2500 or ─),
+ * right-tee piece (\u251c or ├) and 'L' shaped piece (\u2514 or └). (For more
+ * information see the web site https://jrgraphix.net/r/Unicode/2500-257F).
+ * While these characters can be represented using the wchar_t variable type,
+ * however, this is not portable and introduces a number of other issues (e.g.
+ * functions like strlen() )..  The preferred method is to use UTF-8 coding
+ * which encodes 16 bit unicode characters into a 3 byte codes as follows:
+ * 1110-xxxx 10xx xxxx 10xx-xxxx.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintInit (void)
+{
+    int          i;
+    static int   initialised = 0;
+    char        *p;
+    static char  h[] = {0xe2, 0x94, 0x80,      /* \u2500 -  ─  Horiz light   */
+                        0xe2, 0x94, 0x81,      /* \u2501             heavy   */
+                        0xe2, 0x95, 0x90};     /* \u2550             double  */
+    static char  v[] = {0xe2, 0x94, 0x82,      /* \u2502 -  │  Vert  light   */
+                        0xe2, 0x94, 0x83,      /* \u2503             heavy   */
+                        0xe2, 0x95, 0x91};     /* \u2551             double  */
+    static char  t[] = {0xe2, 0x94, 0x9c,      /* \u251c -  ├  tee   light   */
+                        0xe2, 0x94, 0xa0,      /* \u2520             heavy   */
+                        0xe2, 0x95, 0xa0};     /* \u2560             double  */
+    static char  l[] = {0xe2, 0x94, 0x94,      /* \u2514 -  └  L     light   */
+                        0xe2, 0x94, 0x97,      /* \u2517             heavy   */
+                        0xe2, 0x95, 0x9a};     /* \u255a             double  */
+    static char  j[] = {0xe2, 0x94, 0x98,      /* \u2518 -  ┘  J     light   */
+                        0xe2, 0x94, 0x9b,      /* \u251b             heavy   */
+                        0xe2, 0x95, 0x9d};     /* \u255d             double  */
+    static char  b[] = {0xe2, 0x94, 0x8c,      /* \u250c -  ┌  J     light   */
+                        0xe2, 0x94, 0x8f,      /* \u250f             heavy   */
+                        0xe2, 0x95, 0x94};     /* \u2554             double  */
+    XTType       g;
+
+    if (initialised == 0)
+    {
+        g = xt_treeType;
+
+        p = xt_space;                             /* Build buffer with spaces only*/
+        for (i = 0; i < XT_INDENT + 1; i++)
+            *p++ = ' ';
+        *p = '\0';
+
+        if (xt_showTree == 1 || xt_traceLines == 1)
+        {
+            p = xt_vlinSpace;                     /* Build vertical line + spaces */
+            *p++ = v[g+0]; *p++ = v[g+1];*p++ = v[g+2];        /*  "│    "        */
+            for (i = 0; i < XT_INDENT; i++)
+                *p++ = ' ';
+            *p = '\0';
+
+            p = xt_teeHoriz;                      /* Build 't' piece + horiz lines */
+            *p++ = t[g+0];  *p++ = t[g+1];  *p++ = t[g+2];     /*  "├─── "         */
+            for (i = 0; i < XT_INDENT - 1; i++)
+            {
+                *p++ = h[g+0];
+                *p++ = h[g+1];
+                *p++ = h[g+2];
+            }
+            *p++ = ' ';
+            *p = '\0';
+
+            p = xt_LHoriz;                        /* Build 'L' piece + horiz lines */
+            *p++ = l[g+0];  *p++ = l[g+1];  *p++ = l[g+2];     /*  "└─── "         */
+            for (i = 0; i < XT_INDENT - 1; i++)
+            {
+                *p++ = h[g+0];
+                *p++ = h[g+1];
+                *p++ = h[g+2];
+            }
+            *p++ = ' ';
+            *p = '\0';
+
+            p = xt_SHoriz;                        /* Build sideways 'S' piece       */
+            *p++ = b[g+0];  *p++ = b[g+1];  *p++ = b[g+2];     /*  "┌───┘ "         */
+            for (i = 0; i < XT_INDENT - 1; i++)
+            {
+                *p++ = h[g+0];
+                *p++ = h[g+1];
+                *p++ = h[g+2];
+            }
+            *p++ = j[g+0];  *p++ = j[g+1];  *p++ = j[g+2];
+            *p = '\0';
+        }
+        else
+        {
+            memset (xt_vlinSpace, ' ', XT_INDENT + 1);   xt_vlinSpace [XT_INDENT + 1] = '\0';
+            memset (xt_teeHoriz,  ' ', XT_INDENT + 1);   xt_teeHoriz [XT_INDENT + 1]  = '\0';
+            memset (xt_LHoriz,    ' ', XT_INDENT + 1);   xt_LHoriz [XT_INDENT + 1]    = '\0';
+            memset (xt_SHoriz,    ' ', XT_INDENT + 1);   xt_SHoriz [XT_INDENT + 1]    = '\0';
+        }
+
+        initialised = 1;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This function retreives the current "time" in seconds, read from the same
+ * clock as XT_GetTicks().  It is only called when the timer is enabled.
+ */
+
+__attribute__ ((no_instrument_function))
+double XT_GetTime (void)
+{
+    return ((double) XT_GetTicks () / 1000000000.0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This function returns a monotonic clock in seconds regardless of the value
+ * of xt_timer.  It is used internally (e.g. by the adaptive mode) where a time
+ * is needed even though no times are being reported.
+ */
+
+__attribute__ ((no_instrument_function))
+double XT_GetClock (void)
+{
+    struct timespec  t;
+
+    clock_gettime (CLOCK_MONOTONIC, & t);
+    return ((double) t.tv_sec + (double) t.tv_nsec / 1000000000.0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the time recorded in the call tree, in nanoseconds (ticks).  This is
+ * the processor time used by the program or a monotonic clock, as selected by
+ * xt_timer when tracing starts (xt_clockId), so no test is needed here.  It is
+ * only called when the timer is enabled.  XT_GetCpuTicks() returns the
+ * processor time used by the calling thread, kept along with the clock time
+ * when xt_timer is XT_TIMER_BOTH.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned long long XT_GetTicks (void)
+{
+    struct timespec  t;
+
+    clock_gettime (xt_clockId, & t);
+    return ((unsigned long long) t.tv_sec * 1000000000ull + (unsigned long long) t.tv_nsec);
+}
+
+
+__attribute__ ((no_instrument_function))
+unsigned long long XT_GetCpuTicks (void)
+{
+    struct timespec  t;
+
+    clock_gettime (CLOCK_THREAD_CPUTIME_ID, & t);
+    return ((unsigned long long) t.tv_sec * 1000000000ull + (unsigned long long) t.tv_nsec);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * This simple function outputs the elapsed time based on start and end values
+ * assumed to be in seconds.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintElapsedTime (double start, double end)
+{
+    double    elapsedTime;
+
+    elapsedTime = end - start;
+
+    if (elapsedTime > 1.0)
+        XT_OUT ("  [%.2f S]", elapsedTime);
+    else if (elapsedTime > 0.001)
+        XT_OUT ("  [%.2f mS]", elapsedTime * 1000.0);
+    else if (elapsedTime > 0.000001)
+        XT_OUT ("  [%.0f uS]", elapsedTime * 1000000.0);
+    else
+        XT_OUT ("  [%.0f nS]", elapsedTime * 1000000000.0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the thread CPU time of a call and the time it spent off the CPU, the
+ * rest of its clock time, both in nanoseconds.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintCpuTime (unsigned long long wall, unsigned long long cpu)
+{
+    XT_OUT ("  cpu");
+    XT_PrintElapsedTime (0.0, (double) cpu / 1000000000.0);
+    XT_OUT ("  off cpu");
+    XT_PrintElapsedTime (0.0, (double) ((wall > cpu) ? wall - cpu : 0) / 1000000000.0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Release the memory associated with the function name strings as well as the memory
+ * used to store each node of the call tree.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Cleanup (void)
+{
+    if (xt_funcNames != NULL)
+    {
+        XT_FREE (xt_funcNames);
+        xt_funcNames = NULL;
+    }
+
+    if (xt_pNameHash != NULL)
+    {
+        XT_FREE (xt_pNameHash);
+        XT_FREE (xt_pNameAt);
+        XT_FREE (xt_pShowAt);
+        xt_pNameHash = NULL;
+        xt_pNameAt = NULL;
+        xt_pShowAt = NULL;
+        xt_nShown = 0;
+        xt_nameHashSize = 0;
+        xt_nNames = 0;
+    }
+
+    XT_FREE (xt_pBars);
+    XT_FREE (xt_pLine);
+    XT_FREE (xt_pHold);
+    xt_pBars = NULL;
+    xt_pLine = NULL;
+    xt_pHold = NULL;
+    xt_holdLen = 0;
+    xt_holdGuessed = 0;
+    xt_printLevels = 0;
+
+    if (xt_pLevel != NULL)
+    {
+        XT_FREE (xt_pLevel);
+        XT_FREE (xt_pCheck);
+        XT_FREE (xt_pData);
+        XT_FREE (xt_pOpen);
+        XT_FREE (xt_pLines);
+        xt_pLevel = NULL;
+        xt_pCheck = NULL;
+        xt_pData = NULL;
+        xt_pOpen = NULL;
+        xt_pLines = NULL;
+        xt_treeSize = xt_nextBranch = 0;
+        xt_levelsSize = xt_levelBase = 0;
+        xt_dataSize = xt_dataUsed = xt_dataBase = 0;
+        xt_openSize = xt_nLines = xt_linesSize = 0;
+    }
+
+#ifdef XT_X_SPILL
+    XT_SpillFinish ();
+    XT_SpillFreeCache ();
+    if (xt_spiller.fp != NULL)
+    {
+        fclose (xt_spiller.fp);
+        xt_spiller.fp = NULL;
+        xt_spiller.end = 0;
+    }
+    XT_FREE (xt_dataSpill.pBlocks);
+    XT_FREE (xt_levelSpill.pBlocks);
+    xt_dataSpill.pBlocks = xt_levelSpill.pBlocks = NULL;
+    xt_dataSpill.nBlocks = xt_levelSpill.nBlocks = 0;
+    xt_dataSpill.blocksSize = xt_levelSpill.blocksSize = 0;
+#endif
+
+    if (xt_pCounts != NULL)
+    {
+        XT_FREE (xt_pCounts);
+        xt_pCounts = NULL;
+        xt_countsSize = 0;
+    }
+
+    if (xt_pCpu != NULL)
+    {
+        XT_FREE (xt_pCpu);
+        xt_pCpu = NULL;
+        xt_cpuSize = 0;
+    }
+
+    if (xt_pAllocs != NULL)
+    {
+        XT_FREE (xt_pAllocs);
+        xt_pAllocs = NULL;
+        xt_allocsSize = 0;
+    }
+
+    if (xt_pPruned != NULL)
+    {
+        XT_FREE (xt_pPruned);
+        xt_pPruned = NULL;
+        xt_prunedSize = 0;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Locate the entry for a function address in the function table, adding it if
+ * it is not already present.  The table uses open addressing with linear
+ * probing.  A free slot is claimed with an atomic compare and exchange so that
+ * several threads can add functions at the same time without a lock.  NULL is
+ * returned if the table is full or was never allocated.
+ */
+
+__attribute__ ((no_instrument_function))
+XTFunc *XT_FindFunction (void *addr)
+{
+    unsigned  i, n;
+    void     *pAddr;
+    XTFunc   *pFunc;
+
+    if (xt_pFuncTable == NULL)
+        return (NULL);
+
+    i = (unsigned) (((uintptr_t) addr >> 4) * 2654435761u) & (XT_FUNC_TABLE - 1);
+
+    for (n = 0;  n < XT_FUNC_TABLE;  n++)
+    {
+        pFunc = & xt_pFuncTable [i];
+        pAddr = __atomic_load_n (& pFunc->addr, __ATOMIC_ACQUIRE);
+        if (pAddr == addr)
+            return (pFunc);
+        if (pAddr == NULL)                    /* Free slot, so add it here. */
+        {
+            if (__atomic_compare_exchange_n (& pFunc->addr, & pAddr, addr, 0,
+                                             __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            {
+                pFunc->firstCall = XT_GetClock ();
+                return (pFunc);
+            }
+            if (pAddr == addr)                /* Another thread added it.   */
+                return (pFunc);
+        }
+        i = (i + 1) & (XT_FUNC_TABLE - 1);
+    }
+    return (NULL);                            /* Table full.                */
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Measure the approximate cost of recording a single function call so that the
+ * adaptive mode can turn the overhead budget into thresholds without any help
+ * from the user.  The work timed here is what the hooks do for every call that
+ * is not suppressed: the symbol lookup plus reading the time on entry and exit.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_AdaptInit (void *this_fn)
+{
+    int       i;
+    double    start;
+    Dl_info   info;
+
+    start = XT_GetClock ();
+    for (i = 0;  i < 100;  i++)
+    {
+        dladdr (this_fn, & info);
+        if (xt_timer != XT_TIMER_DISABLED)
+        {
+            XT_GetTicks ();
+            XT_GetTicks ();
+        }
+    }
+    xt_hookCost = (XT_GetClock () - start) / 100.0;
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Called by the exit hook in adaptive mode for functions that are not yet
+ * suppressed.  When the outermost invocation of a function returns, its time
+ * is accumulated and, once enough calls have been seen, the function is
+ * suppressed if both of the following are true:
+ *  - Its calls arrive fast enough that the hooks alone would use more than
+ *    the budget of the time since it was first called.
+ *  - It returns so quickly on average that the hooks would cost more than the
+ *    budget of its own run time.
+ * A function is only ever suppressed when none of its invocations are open,
+ * so recursive functions cannot leave an unmatched node behind.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_AdaptExit (XTFunc *pFunc)
+{
+    double    now, budget;
+
+    if (--pFunc->active != 0)
+        return;
+
+    now = XT_GetClock ();
+    pFunc->calls++;
+    pFunc->totalTime += now - pFunc->enterTime;
+
+    if (pFunc->calls >= XT_ADAPT_CALLS)
+    {
+        budget = xt_adaptBudget / 100.0;
+        if ((double) pFunc->calls * xt_hookCost > budget * (now - pFunc->firstCall) &&
+            pFunc->totalTime / (double) pFunc->calls * budget < xt_hookCost)
+            pFunc->suppressed = 1;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * List the functions suppressed by the adaptive mode along with the number of
+ * calls recorded before the function was suppressed and the number absorbed
+ * afterwards.  Their time is included in the times of their callers.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintSuppressed (void)
+{
+    unsigned  i;
+    int       header = 0;
+    Dl_info   info;
+    char     *pName;
+    XTFunc   *pFunc;
+
+    for (i = 0;  xt_pFuncTable != NULL && i < XT_FUNC_TABLE;  i++)
+    {
+        pFunc = & xt_pFuncTable [i];
+        if (pFunc->suppressed == 0)
+            continue;
+
+        if (header == 0)
+        {
+            XT_OUT ("\nSuppressed (time included in callers):\n");
+            header = 1;
+        }
+        if (dladdr (pFunc->addr, & info) == 0 || info.dli_sname == NULL)
+            info.dli_sname = "???";
+        pName = XT_DemangleName (info.dli_sname);
+        XT_OUT ("    %s%s" XT_COL_RESET "  %lu calls (%lu recorded)\n", xt_pNameCol,
+                (pName != NULL) ? pName : info.dli_sname, pFunc->calls + pFunc->skipped, pFunc->calls);
+        XT_FREE (pName);
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Merge the nodes of the call tree with the same call path (e.g. main;func1;
+ * func2) into a single calling context, so the number of contexts depends on
+ * the number of distinct paths rather than the number of calls.  Contexts are
+ * found through a hash table keyed on the parent context and the function
+ * name.  As nodes are stored in call order, a child always follows its parent,
+ * so each context is created after its parent and the self time of the parent
+ * can be obtained simply by subtracting the total time of each child as it is
+ * seen.  Returns the contexts, with their number in *pCount, or NULL if there
+ * is not enough memory.  The caller must release them with XT_FREE().
+ */
+
+__attribute__ ((no_instrument_function))
+XTContext *XT_Contexts (unsigned *pCount)
+{
+    unsigned    i, n, c, h, nCtx = 0, level, nHash, *pHash, *pStack;
+    double      total;
+    const char *pName;
+    const XTNode *pNode;
+    XTWalk      walk;
+    XTContext  *pCtx, *pC;
+    XTAlloc    *pTotals = NULL;
+
+    XT_Demangle ();
+    for (nHash = 64;  nHash < xt_nextBranch;  nHash *= 2)
+        ;
+    pCtx   = (XTContext *) XT_CALLOC ((size_t) xt_nextBranch, sizeof (XTContext));
+    pHash  = (unsigned *) XT_CALLOC ((size_t) nHash, sizeof (unsigned));
+    pStack = (unsigned *) XT_CALLOC ((size_t) xt_maxLvl + 1, sizeof (unsigned));
+    if (xt_allocs == 1)
+        pTotals = XT_AllocTotals (0, xt_nextBranch);
+
+    walk.pNodes = NULL;
+
+    if (pCtx == NULL || pHash == NULL || pStack == NULL ||
+        (xt_allocs == 1 && pTotals == NULL) ||
+        XT_WalkInit (& walk, 0, xt_nextBranch, 1) != 0)
+    {
+        XT_FREE (pCtx);
+        pCtx = NULL;
+        goto done;
+    }
+
+    while ((pNode = XT_WalkNext (& walk)) != NULL)
+    {
+        i = pNode->index;
+        level = pNode->level;
+        if (level > xt_maxLvl)
+            continue;
+        pName = & xt_funcNames [pNode->nameIndx];
+
+        /* Look for the context (parent, name) and add it if it is new.  Root
+         * functions (normally only main) have no parent context.
+         */
+        n = (level > 0) ? pStack [level - 1] : XT_NO_PARENT;
+        for (h = 5381, c = 0;  pName [c] != '\0';  c++)
+            h = h * 33 + (unsigned char) pName [c];
+        h = (h ^ (n * 2654435761u)) & (nHash - 1);
+
+        for (c = pHash [h];  c != 0;  c = pCtx [c - 1].next)
+        {
+            pC = & pCtx [c - 1];
+            if (pC->parent == n && strcmp (& xt_funcNames [pC->nameIndx], pName) == 0)
+                break;
+        }
+        if (c == 0)
+        {
+            pC = & pCtx [nCtx];
+            pC->parent = n;
+            pC->nameIndx = pNode->nameIndx;
+            pC->next = pHash [h];
+            pHash [h] = ++nCtx;
+            c = nCtx;
+        }
+        pStack [level] = c - 1;
+
+        total = (double) (pNode->exitTime - pNode->enterTime) / 1000000000.0;
+        pC = & pCtx [c - 1];
+        for (n = 0;  n < xt_nCounters && xt_counters == 1;  n++)
+            pC->counts [n] += xt_pCounts [i * xt_nCounters + n];
+        if (xt_allocs == 1)
+        {
+            pC->alloc.bytes += pTotals [i].bytes;
+            pC->alloc.count += pTotals [i].count;
+            pC->alloc.freed += pTotals [i].freed;
+            pC->selfAlloc.bytes += xt_pAllocs [i].bytes;
+            pC->selfAlloc.count += xt_pAllocs [i].count;
+        }
+        if (i < xt_prunedSize)
+        {
+            pC->pruned.calls += xt_pPruned [i].calls;
+            pC->pruned.ticks += xt_pPruned [i].ticks;
+        }
+        pC->calls++;
+        pC->total += total;
+        pC->self += total;
+        if (level > 0)
+            pCtx [pStack [level - 1]].self -= total;
+
+        if (xt_timer == XT_TIMER_BOTH)
+        {
+            total = (double) xt_pCpu [i] / 1000000000.0;
+            pC->cpu += total;
+            pC->selfCpu += total;
+            if (level > 0)
+                pCtx [pStack [level - 1]].selfCpu -= total;
+        }
+    }
+    *pCount = nCtx;
+
+done:
+    if (walk.pNodes != NULL)
+        XT_WalkFree (& walk);
+    XT_FREE (pHash);
+    XT_FREE (pStack);
+    XT_FREE (pTotals);
+    return (pCtx);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Save the call tree as an aggregated profile (see XT_Contexts()) in the file
+ * xt_pProfileFile.  The file starts with two comment lines naming the format
+ * and the fields, followed by one line per context:
+ *     <calls> <total> <self> <name>;<name>;...
+ * Times are in seconds.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SaveProfile (void)
+{
+    FILE       *fp = NULL;
+    unsigned    i, n, c, nCtx, *pPath;
+    XTContext  *pCtx, *pC;
+
+    if (xt_pLevel == NULL || xt_nextBranch == 0)
+        return;
+
+    pCtx  = XT_Contexts (& nCtx);
+    pPath = (unsigned *) XT_CALLOC ((size_t) xt_maxLvl + 1, sizeof (unsigned));
+    if (pCtx == NULL || pPath == NULL || (fp = fopen (xt_pProfileFile, "w")) == NULL)
+    {
+        fprintf (stderr, "Could not save profile to %s\n", xt_pProfileFile);
+        goto done;
+    }
+
+    fprintf (fp, "# xt-profile 1\n");
+    fprintf (fp, "# fields: calls total self");
+    for (n = 0;  n < xt_nCounters && xt_counters == 1;  n++)
+        fprintf (fp, " %s", xt_pEvents [n].pName);
+    if (xt_allocs == 1)
+        fprintf (fp, " alloc_bytes allocs freed_bytes self_alloc_bytes self_allocs");
+    if (xt_pPruned != NULL)
+        fprintf (fp, " pruned_calls pruned_time");
+    if (xt_timer == XT_TIMER_BOTH)
+        fprintf (fp, " cpu self_cpu");
+    fprintf (fp, "\n");
+
+    for (c = 0;  c < nCtx;  c++)
+    {
+        pC = & pCtx [c];
+        fprintf (fp, "%lu %.9f %.9f ", pC->calls, pC->total, pC->self);
+        for (n = 0;  n < xt_nCounters && xt_counters == 1;  n++)
+            fprintf (fp, "%llu ", pC->counts [n]);
+        if (xt_allocs == 1)
+            fprintf (fp, "%llu %llu %llu %llu %llu ", pC->alloc.bytes, pC->alloc.count,
+                     pC->alloc.freed, pC->selfAlloc.bytes, pC->selfAlloc.count);
+        if (xt_pPruned != NULL)
+            fprintf (fp, "%llu %.9f ", pC->pruned.calls, (double) pC->pruned.ticks / 1000000000.0);
+        if (xt_timer == XT_TIMER_BOTH)
+            fprintf (fp, "%.9f %.9f ", pC->cpu, pC->selfCpu);
+
+        /* Walk back to the root to find the path, then print it in order.
+         */
+        for (n = 0, i = c;  i != XT_NO_PARENT && n <= xt_maxLvl;  i = pCtx [i].parent)
+            pPath [n++] = i;
+        while (n-- > 0)
+            fprintf (fp, "%s%c", & xt_funcNames [pCtx [pPath [n]].nameIndx], (n > 0) ? ';' : '\n');
+    }
+
+done:
+    if (fp != NULL)
+        fclose (fp);
+    XT_FREE (pCtx);
+    XT_FREE (pPath);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print where the time went, after the tree.  The xt_hotPaths call paths (see
+ * XT_Contexts()) that end in a function calling nothing else and take the most
+ * time are listed first, giving for each function along a path its share of
+ * the time of the function that called it.  This is followed by the critical
+ * path (see XT_PrintCriticalPath()).
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintHotPaths (void)
+{
+    unsigned    i, j, n, c, nCtx, nTop = 0, *pTop, *pPath;
+    XTContext  *pCtx, *pC;
+    unsigned char *pInner;
+
+    if (xt_pLevel == NULL || xt_nextBranch == 0)
+        return;
+
+    pCtx   = XT_Contexts (& nCtx);
+    pTop   = (unsigned *) XT_CALLOC ((size_t) xt_hotPaths, sizeof (unsigned));
+    pPath  = (unsigned *) XT_CALLOC ((size_t) xt_maxLvl + 1, sizeof (unsigned));
+    pInner = (pCtx != NULL) ? (unsigned char *) XT_CALLOC ((size_t) nCtx + 1, 1) : NULL;
+    if (pCtx == NULL || pTop == NULL || pPath == NULL || pInner == NULL)
+    {
+        fprintf (stderr, "Not enough memory for the hot paths.\n");
+        goto done;
+    }
+
+    /* Keep the heaviest paths in pTop, heaviest first.  A context is the end
+     * of a path if it is not the parent of any other.
+     */
+    for (c = 0;  c < nCtx;  c++)
+        if (pCtx [c].parent != XT_NO_PARENT)
+            pInner [pCtx [c].parent] = 1;
+    for (c = 0;  c < nCtx;  c++)
+    {
+        if (pInner [c] == 1 || (nTop == xt_hotPaths && pCtx [c].total <= pCtx [pTop [nTop - 1]].total))
+            continue;
+        for (i = (nTop < xt_hotPaths) ? nTop++ : nTop - 1;  i > 0 && pCtx [pTop [i - 1]].total < pCtx [c].total;  i--)
+            pTop [i] = pTop [i - 1];
+        pTop [i] = c;
+    }
+
+    XT_OUT ("\nHot paths (total time, and the share of its caller's time for each call):\n");
+    for (j = 0;  j < nTop;  j++)
+    {
+        pC = & pCtx [pTop [j]];
+        XT_OUT ("%5u", j + 1);
+        XT_PrintElapsedTime (0.0, pC->total);
+        XT_OUT ("  %lu call%s ", pC->calls, (pC->calls == 1) ? "" : "s");
+
+        for (n = 0, i = pTop [j];  i != XT_NO_PARENT && n <= xt_maxLvl;  i = pCtx [i].parent)
+            pPath [n++] = i;
+        while (n-- > 0)
+        {
+            pC = & pCtx [pPath [n]];
+            XT_OUT (" %s%s" XT_COL_RESET, xt_pNameCol, & xt_funcNames [pC->nameIndx]);
+            if (pC->parent != XT_NO_PARENT && pCtx [pC->parent].total > 0.0)
+                XT_OUT (" %.1f%%", pC->total * 100.0 / pCtx [pC->parent].total);
+            if (n > 0)
+                XT_OUT (" >");
+        }
+        XT_OUT ("\n");
+    }
+
+    XT_PrintCriticalPath ();
+
+done:
+    XT_FREE (pCtx);
+    XT_FREE (pTop);
+    XT_FREE (pPath);
+    XT_FREE (pInner);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the critical path: the longest call of main() (or of the longest root
+ * function), then the longest call it made, and so on down to a call that
+ * made no others.  This single chain of calls, each running inside the one
+ * before, is where a run spent its time.  Each call is printed with its time,
+ * its share of its caller's time and its self time (its time less that of the
+ * calls it made).  The calls of a node are found by scanning the levels of its
+ * subtree, and only the nodes along the chain are decoded.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintCriticalPath (void)
+{
+    unsigned            i, j, first = 0, end = xt_nextBranch, level = 0;
+    unsigned            best, bestEnd = 0, name = 0;
+    unsigned long long  ticks, longest = 0, caller = 0, sum;
+    XTNode              node;
+
+    XT_OUT ("\nCritical path (the longest call at each level, its share of its caller and its self time):\n");
+    for (;;)
+    {
+        /* Find the longest call at this level within the range, adding up
+         * the time of all of them as these are the calls made by the last
+         * call printed.
+         */
+        best = XT_NO_PARENT;
+        for (sum = 0, i = first;  i < end;  i = j)
+        {
+            for (j = i + 1;  j < end && XT_Level (j) > level;  j++)
+                ;
+            XT_ReadNode (i, & node);
+            XT_ReadTimes (& node, j);
+            ticks = node.exitTime - node.enterTime;
+            sum += ticks;
+            if (best == XT_NO_PARENT || ticks > longest)
+            {
+                best = i;
+                bestEnd = j;
+                longest = ticks;
+                name = node.nameIndx;
+            }
+        }
+
+        if (level > 0)                   /* Self time of the last printed.  */
+        {
+            XT_OUT ("  self");
+            XT_PrintElapsedTime (0.0, (double) (caller - ((sum < caller) ? sum : caller)) / 1000000000.0);
+            XT_OUT ("\n");
+        }
+        if (best == XT_NO_PARENT)
+            break;
+
+        XT_OUT ("%5u  %s%s" XT_COL_RESET, level, xt_pNameCol, & xt_funcNames [name]);
+        XT_PrintElapsedTime (0.0, (double) longest / 1000000000.0);
+        if (xt_timer == XT_TIMER_BOTH)
+            XT_PrintCpuTime (longest, xt_pCpu [best]);
+        if (level > 0 && caller > 0)
+            XT_OUT ("  %.1f%%", (double) longest * 100.0 / (double) caller);
+
+        caller = longest;
+        first = best + 1;
+        end = bestEnd;
+        level++;
+    }
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Open the performance counters used to measure each function call.  All the
+ * counters are opened as one group so they are scheduled (and read) together.
+ * The hardware counters are tried first, and if the first of these cannot be
+ * opened (no PMU, as in most containers and virtual machines, or not allowed)
+ * the software counters are used instead.  Kernel activity is counted where
+ * permitted, otherwise user space only.  Where the kernel allows user space
+ * to read a counter directly, its control page is mapped so XT_ReadCounters()
+ * can use the rdpmc instruction rather than a system call.
+ * Returns 0 on success or -1 if no counters could be opened.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_CountersInit (void)
+{
+#ifdef __linux__
+    unsigned                  i, n, try;
+    long                      page;
+    const XTEvent            *pEvents;
+    struct perf_event_attr    attr;
+
+    for (try = 0;  try < 2 && xt_nCounters == 0;  try++)
+    {
+        pEvents = (try == 0) ? xt_hwEvents : xt_swEvents;
+        n = (try == 0) ? sizeof (xt_hwEvents) / sizeof (XTEvent) : sizeof (xt_swEvents) / sizeof (XTEvent);
+
+        for (i = 0;  i < n;  i++)
+        {
+            memset (& attr, 0, sizeof (attr));
+            attr.size = sizeof (attr);
+            attr.type = pEvents [i].type;
+            attr.config = pEvents [i].config;
+            attr.read_format = PERF_FORMAT_GROUP;
+            attr.exclude_hv = 1;
+
+            xt_cntFd [i] = (int) syscall (SYS_perf_event_open, & attr, 0, -1,
+                                          (i == 0) ? -1 : xt_cntFd [0], 0);
+            if (xt_cntFd [i] < 0)
+            {
+                attr.exclude_kernel = 1;             /* Try user space only. */
+                xt_cntFd [i] = (int) syscall (SYS_perf_event_open, & attr, 0, -1,
+                                              (i == 0) ? -1 : xt_cntFd [0], 0);
+            }
+            if (xt_cntFd [i] < 0)
+                break;
+        }
+
+        if (i < n)                    /* Not all opened, so try the next set. */
+        {
+            while (i-- > 0)
+                close (xt_cntFd [i]);
+            continue;
+        }
+
+        xt_nCounters = n;
+        xt_pEvents = pEvents;
+    }
+
+    if (xt_nCounters == 0)
+        return (-1);
+
+    page = sysconf (_SC_PAGESIZE);
+    for (i = 0;  i < xt_nCounters;  i++)
+    {
+        xt_cntPage [i] = mmap (NULL, (size_t) page, PROT_READ, MAP_SHARED, xt_cntFd [i], 0);
+        if (xt_cntPage [i] == MAP_FAILED)
+            xt_cntPage [i] = NULL;
+    }
+    return (0);
+#else
+    return (-1);
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Read the current value of every open counter.  On x86 processors, where the
+ * kernel allows it, each counter is read directly with the rdpmc instruction.
+ * This takes a few nS compared to a microsecond or so for the read() system
+ * call.  The values are made consistent using the sequence lock in the mapped
+ * control page; if any counter is not currently loaded on the PMU (index 0) or
+ * user reads are not allowed, the whole group is read with read() instead.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ReadCounters (unsigned long long *pValue)
+{
+#ifdef __linux__
+    unsigned                       i, seq;
+    unsigned long long             buff [XT_COUNTERS + 1];
+    volatile struct perf_event_mmap_page  *pc;
+
+#if defined (__x86_64__) || defined (__i386__)
+    unsigned      idx, lo, hi;
+    long long     pmc;
+
+    for (i = 0;  i < xt_nCounters;  i++)
+    {
+        if ((pc = (volatile struct perf_event_mmap_page *) xt_cntPage [i]) == NULL)
+            break;
+        do
+        {
+            seq = pc->lock;
+            __sync_synchronize ();
+            idx = pc->index;
+            if (pc->cap_user_rdpmc == 0 || idx == 0)
+                break;
+            __asm__ volatile ("rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx - 1));
+            pmc = (long long) (((unsigned long long) hi << 32) | lo);
+            pmc = (long long) ((unsigned long long) pmc << (64 - pc->pmc_width)) >> (64 - pc->pmc_width);
+            pValue [i] = (unsigned long long) (pc->offset + pmc);
+            __sync_synchronize ();
+        }
+        while (pc->lock != seq);
+
+        if (pc->cap_user_rdpmc == 0 || idx == 0)
+            break;
+    }
+    if (i == xt_nCounters)
+        return;
+#endif
+
+    /* The slow path.  With PERF_FORMAT_GROUP, reading the group leader returns
+     * the number of counters followed by the value of each one.
+     */
+    UNUSED (pc);
+    UNUSED (seq);
+    if (read (xt_cntFd [0], buff, sizeof (buff)) > 0)
+        for (i = 0;  i < xt_nCounters && i < buff [0];  i++)
+            pValue [i] = buff [i + 1];
+#else
+    UNUSED (pValue);
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the counts used by one call after the function name.  With hardware
+ * counters, instructions per cycle are shown rather than the raw counts.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintCounters (const unsigned long long *pValue)
+{
+    unsigned   i = 0;
+
+    XT_OUT ("  {");
+    if (xt_nCounters >= 2 && strcmp (xt_pEvents [0].pName, "cycles") == 0)
+    {
+        XT_OUT ("IPC %.2f", (pValue [0] != 0) ? (double) pValue [1] / (double) pValue [0] : 0.0);
+        i = 2;
+    }
+    for (;  i < xt_nCounters;  i++)
+        XT_OUT ("%s%llu %s", (i > 0) ? ", " : "", pValue [i], xt_pEvents [i].pLabel);
+    XT_OUT ("}");
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Work out the allocations made by each node from first to end - 1 including
+ * all the functions it called.  As children always follow their parents in the
+ * tree, a single pass from the end is enough: the totals of the children seen
+ * since the last node at each level are summed in pSum[level], and added to
+ * the parent when it is reached.  Returns a new array indexed from first
+ * (freed by the caller) or NULL if out of memory.
+ */
+
+__attribute__ ((no_instrument_function))
+XTAlloc *XT_AllocTotals (unsigned first, unsigned end)
+{
+    unsigned   i, level, nLevels = 0;
+    XTAlloc   *pTotals, *pSum, *pTotal;
+
+    for (i = first;  i < end;  i++)
+        if (XT_Level (i) >= nLevels)
+            nLevels = XT_Level (i) + 1u;
+
+    pTotals = (XTAlloc *) XT_CALLOC ((size_t) (end - first) + 1, sizeof (XTAlloc));
+    pSum = (XTAlloc *) XT_CALLOC ((size_t) nLevels + 1, sizeof (XTAlloc));
+    if (pTotals == NULL || pSum == NULL || xt_pAllocs == NULL)
+    {
+        XT_FREE (pSum);
+        return (pTotals);
+    }
+
+    memcpy (pTotals, & xt_pAllocs [first], (size_t) (end - first) * sizeof (XTAlloc));
+    for (i = end;  i-- > first;  )
+    {
+        level = XT_Level (i);
+        pTotal = & pTotals [i - first];
+        pTotal->bytes += pSum [level + 1].bytes;
+        pTotal->count += pSum [level + 1].count;
+        pTotal->freed += pSum [level + 1].freed;
+        memset (& pSum [level + 1], 0, sizeof (XTAlloc));
+
+        pSum [level].bytes += pTotal->bytes;
+        pSum [level].count += pTotal->count;
+        pSum [level].freed += pTotal->freed;
+    }
+    XT_FREE (pSum);
+    return (pTotals);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Print the allocations of one call after the function name as the total and
+ * self bytes/allocations followed by the bytes freed, e.g.
+ *     <alloc 1.20 KB/3, self 512 B/1, freed 1.00 KB>
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_PrintAllocs (const XTAlloc *pTotal, const XTAlloc *pSelf)
+{
+    int                 i, n;
+    double              value;
+    unsigned long long  bytes [3];
+    static const char  *units [] = {"B", "KB", "MB", "GB", "TB"};
+    static const char  *labels [] = {"alloc", ", self", ", freed"};
+
+    bytes [0] = pTotal->bytes;
+    bytes [1] = pSelf->bytes;
+    bytes [2] = pTotal->freed;
+
+    XT_OUT ("  <");
+    for (i = 0;  i < 3;  i++)
+    {
+        value = (double) bytes [i];
+        for (n = 0;  value >= 1024.0 && n < 4;  n++)
+            value /= 1024.0;
+        if (n == 0)
+            XT_OUT ("%s %.0f B", labels [i], value);
+        else
+            XT_OUT ("%s %.2f %s", labels [i], value, units [n]);
+        if (i < 2)
+            XT_OUT ("/%llu", (i == 0) ? pTotal->count : pSelf->count);
+    }
+    XT_OUT (">");
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Create the shadow stack for the calling thread and add it to the list of
+ * all stacks.  Stacks are added at the head of the list with an atomic compare
+ * and exchange so threads never wait for each other, and they are never
+ * removed, so the control thread can walk the list at any time.  Returns NULL
+ * if there is no memory.
+ */
+
+__attribute__ ((no_instrument_function))
+XTStack *XT_StackInit (void)
+{
+    XTStack   *pStack;
+
+    if ((pStack = (XTStack *) XT_CALLOC (1, sizeof (XTStack))) == NULL)
+        return (NULL);
+
+#ifdef __linux__
+    pStack->tid = syscall (SYS_gettid);
+#else
+    pStack->tid = (long) getpid ();
+#endif
+    pStack->pNext = __atomic_load_n (& xt_pStacks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n (& xt_pStacks, & pStack->pNext, pStack, 1,
+                                         __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    return (xt_pStack = pStack);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Push a function on the shadow stack of the calling thread as it is entered.
+ * The frame is filled in before the depth is raised so that a reader never
+ * sees a frame that has not been written.  As the control thread reads the
+ * times while they may change, they are only accessed with atomic loads and
+ * stores.  Calls nested deeper than the stack are counted but not kept.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_StackPush (void *this_fn)
+{
+    XTStack   *pStack;
+    XTFrame   *pFrame;
+    unsigned   depth;
+    double     now, zero = 0.0;
+
+    if ((pStack = xt_pStack) == NULL && (pStack = XT_StackInit ()) == NULL)
+        return;
+
+    depth = pStack->depth;
+    if (depth < XT_STACK_MAX)
+    {
+        pFrame = & pStack->frame [depth];
+        __atomic_store_n (& pFrame->fn, this_fn, __ATOMIC_RELAXED);
+        now = XT_GetClock ();
+        __atomic_store (& pFrame->enterTime, & now, __ATOMIC_RELAXED);
+        __atomic_store (& pFrame->childTime, & zero, __ATOMIC_RELAXED);
+    }
+    else
+        __atomic_fetch_add (& xt_dropFrames, 1, __ATOMIC_RELAXED);
+
+    __atomic_store_n (& pStack->depth, depth + 1, __ATOMIC_RELEASE);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Pop a function from the shadow stack of the calling thread as it returns.
+ * Its run time, less the time of the functions it called, is added to the
+ * self time of the function in the function table, and its whole run time is
+ * added to the child time of its caller.  The table entries are only ever
+ * increased with atomic adds, so no lock is needed.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_StackPop (void *this_fn)
+{
+    XTStack   *pStack;
+    XTFrame   *pFrame;
+    XTFunc    *pFunc;
+    unsigned   depth;
+    double     total, self, enter, child;
+
+    if ((pStack = xt_pStack) == NULL || (depth = pStack->depth) == 0)
+        return;
+
+    __atomic_store_n (& pStack->depth, --depth, __ATOMIC_RELEASE);
+    if (depth >= XT_STACK_MAX)
+        return;
+
+    pFrame = & pStack->frame [depth];
+    __atomic_load (& pFrame->enterTime, & enter, __ATOMIC_RELAXED);
+    __atomic_load (& pFrame->childTime, & child, __ATOMIC_RELAXED);
+    total = XT_GetClock () - enter;
+    self = total - child;
+    if (depth > 0)
+    {
+        pFrame = & pStack->frame [depth - 1];
+        __atomic_load (& pFrame->childTime, & child, __ATOMIC_RELAXED);
+        child += total;                    /* Only this thread writes it.  */
+        __atomic_store (& pFrame->childTime, & child, __ATOMIC_RELAXED);
+    }
+
+    if ((pFunc = XT_FindFunction (this_fn)) == NULL)
+    {
+        __atomic_fetch_add (& xt_dropFuncs, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    __atomic_fetch_add (& pFunc->liveCalls, 1, __ATOMIC_RELAXED);
+    if (self > 0.0)
+        __atomic_fetch_add (& pFunc->liveSelf, (unsigned long long) (self * 1000000000.0),
+                            __ATOMIC_RELAXED);
+}
+
+
+
+#ifdef XT_X_SAMPLE
+
+/*-----------------------------------------------------------------------------
+ * Start sampling: allocate the tree of samples, create the shadow stack of the
+ * thread running main() and start the profiling timer.  Times in the tree are
+ * then the CPU time of the samples, and the options that need every call to
+ * be recorded are turned off.  Returns 0 on success and -1 on failure.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_SampleInit (void)
+{
+    struct sigaction   act;
+    struct itimerval   timer;
+    long               usecs;
+
+    if ((xt_pSamples = (XTSample *) XT_CALLOC (XT_SAMPLE_NODES, sizeof (XTSample))) == NULL)
+        return (-1);
+    xt_nSamples = 1;                   /* Node 0 is the root.           */
+
+    usecs = (xt_sampleRate >= 1000000) ? 1 : 1000000 / (long) xt_sampleRate;
+    xt_samplePeriod = (unsigned long long) usecs * 1000ull;
+
+    memset (& act, 0, sizeof (act));
+    act.sa_handler = XT_SampleSignal;
+    act.sa_flags = SA_RESTART;
+    sigemptyset (& act.sa_mask);
+
+    memset (& timer, 0, sizeof (timer));
+    timer.it_interval.tv_usec = (suseconds_t) usecs;
+    timer.it_value.tv_usec = (suseconds_t) usecs;
+
+    if ((xt_pSampleStack = XT_StackInit ()) == NULL ||
+        sigaction (SIGPROF, & act, NULL) != 0 ||
+        setitimer (ITIMER_PROF, & timer, NULL) != 0)
+    {
+        XT_FREE (xt_pSamples);
+        xt_pSamples = NULL;
+        return (-1);
+    }
+
+    xt_timer = XT_TIMER_SAMPLES;
+    xt_adaptive = 0;
+    xt_counters = 0;
+    xt_allocs = 0;
+    xt_flushDepth = 0;
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Push a function on the shadow stack of the calling thread when sampling.
+ * Unlike XT_StackPush(), nothing but the function is kept.  The frame is
+ * written before the depth is raised, so the signal handler never sees a
+ * frame that has not been written.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SamplePush (void *this_fn)
+{
+    XTStack   *pStack;
+    unsigned   depth;
+
+    if ((pStack = xt_pStack) == NULL && (pStack = XT_StackInit ()) == NULL)
+        return;
+
+    depth = pStack->depth;
+    if (depth < XT_STACK_MAX)
+        __atomic_store_n (& pStack->frame [depth].fn, this_fn, __ATOMIC_RELAXED);
+    __atomic_store_n (& pStack->depth, depth + 1, __ATOMIC_RELEASE);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Pop a function from the shadow stack of the calling thread when sampling.
+ * Returns 1 if the thread has no more functions running, otherwise 0.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_SamplePop (void)
+{
+    XTStack   *pStack;
+    unsigned   depth;
+
+    if ((pStack = xt_pStack) == NULL || (depth = pStack->depth) == 0)
+        return (0);
+
+    __atomic_store_n (& pStack->depth, --depth, __ATOMIC_RELEASE);
+    return ((depth == 0) ? 1 : 0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The exit path used when sampling (XT_SamplePush() is the enter path).  When
+ * main() returns, the tree of samples becomes the call tree and is printed.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ExitSample (void *this_fn)
+{
+    UNUSED (this_fn);
+
+    if (xt_enabled != 1 || XT_SamplePop () == 0 || xt_pStack != xt_pSampleStack)
+        return;
+
+    XT_SampleTree ();                  /* main() has returned.              */
+    if (xt_enabled == 1)
+        XT_Finish ();
+    XT_Close ();
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The SIGPROF handler, run by whichever thread was using the CPU.  The path of
+ * functions on its shadow stack is found in, or added to, the tree of samples
+ * and the sample counted against its last function.  Threads share the tree,
+ * so it is guarded by a lock that is only ever tried: a sample taken while
+ * another thread is adding one is dropped rather than waited for.  Functions
+ * deeper than the shadow stack are counted against the deepest one kept.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SampleSignal (int sig)
+{
+    XTStack   *pStack;
+    unsigned   depth, i, n;
+
+    UNUSED (sig);
+
+    if ((pStack = xt_pStack) == NULL ||
+        (depth = __atomic_load_n (& pStack->depth, __ATOMIC_ACQUIRE)) == 0)
+        return;                        /* Not in a traced function.     */
+
+    if (__atomic_test_and_set (& xt_sampleLock, __ATOMIC_ACQUIRE))
+    {
+        __atomic_fetch_add (& xt_dropSamples, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    for (n = 0, i = 0;  i < depth && i < XT_STACK_MAX && n != XT_NO_PARENT;  i++)
+        n = XT_SampleChild (n, pStack->frame [i].fn);
+
+    if (n != XT_NO_PARENT)
+        xt_pSamples [n].count++;
+    else
+        __atomic_fetch_add (& xt_dropSamples, 1, __ATOMIC_RELAXED);
+    __atomic_clear (& xt_sampleLock, __ATOMIC_RELEASE);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the node of fn called from the node parent, adding it after the other
+ * functions called from there if it has not been seen before.  Returns
+ * XT_NO_PARENT if the tree is full.
+ */
+
+__attribute__ ((no_instrument_function))
+unsigned XT_SampleChild (unsigned parent, void *fn)
+{
+    unsigned   n, *pLink;
+
+    for (pLink = & xt_pSamples [parent].child;  (n = *pLink) != 0;  pLink = & xt_pSamples [n].sibling)
+        if (xt_pSamples [n].fn == fn)
+            return (n);
+
+    if (xt_nSamples >= XT_SAMPLE_NODES)
+        return (XT_NO_PARENT);
+
+    n = xt_nSamples++;
+    xt_pSamples [n].fn = fn;
+    xt_pSamples [n].parent = parent;
+    *pLink = n;
+    return (n);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Stop the timer and turn the tree of samples into the call tree, so that it
+ * is printed, and saved, in the same way as a tree of recorded calls.  Each
+ * call path becomes one node, entered and closed in the order it was first
+ * seen, and the clock for its times (xt_sampleTicks) is moved on by the CPU
+ * time of its own samples before it is closed.  The lock is taken, and never
+ * given back, so any sample still to be handled is dropped.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SampleTree (void)
+{
+    struct itimerval   timer;
+    unsigned           n, level = 0;
+    Dl_info            info;
+
+    memset (& timer, 0, sizeof (timer));
+    setitimer (ITIMER_PROF, & timer, NULL);
+    while (__atomic_test_and_set (& xt_sampleLock, __ATOMIC_ACQUIRE))
+        ;
+
+    for (n = xt_pSamples [0].child;  n != 0 && xt_enabled == 1; )
+    {
+        if (dladdr (xt_pSamples [n].fn, & info) == 0 || info.dli_sname == NULL)
+            info.dli_sname = "???";
+        XT_AddBranch (info.dli_sname, NULL, level);
+        if (level >= xt_maxLvl)
+            xt_maxLvl = level + 1;
+
+        if (xt_pSamples [n].child != 0)
+        {
+            n = xt_pSamples [n].child;
+            level++;
+            continue;
+        }
+
+        /* Close the node, and any callers it was the last function of, until
+         * one with a later sibling is found.
+         */
+        while (n != 0)
+        {
+            xt_sampleTicks += xt_pSamples [n].count * xt_samplePeriod;
+            XT_CloseBranch (level);
+            if (xt_pSamples [n].sibling != 0)
+            {
+                n = xt_pSamples [n].sibling;
+                break;
+            }
+            n = xt_pSamples [n].parent;
+            level--;
+        }
+    }
+
+    XT_FREE (xt_pSamples);
+    xt_pSamples = NULL;
+}
+
+#endif  /* XT_X_SAMPLE */
+
+
+
+#ifdef XT_X_SPILL
+
+/*-----------------------------------------------------------------------------
+ * Called instead of growing xt_pData or xt_pLevel by grow bytes.  If that
+ * would take the tree past the memory budget, the older half of the array pMem,
+ * of which used bytes are in use, is queued in whole blocks to be spilled to
+ * disk by the spill thread, and the rest moved down to the start of pMem.
+ * Only waits if the spill thread has fallen XT_SPILL_QUEUE blocks behind.
+ * Returns the number of bytes spilled, or 0 if the array should be grown.
+ */
+
+__attribute__ ((no_instrument_function))
+size_t XT_Spill (XTSpill *pSpill, unsigned char *pMem, size_t used, size_t grow)
+{
+    unsigned     i;
+    size_t       n, done;
+    XTSpiller   *pS = & xt_spiller;
+
+    if (xt_spillBytes == 0 || used < 2 * XT_SPILL_BLOCK ||
+        xt_dataSize + (size_t) xt_levelsSize * sizeof (uint16_t) + grow <= xt_spillBytes ||
+        XT_SpillStart () != 0)
+        return (0);
+
+    n = used / 2 / XT_SPILL_BLOCK * XT_SPILL_BLOCK;
+    pthread_mutex_lock (& pS->lock);
+    for (done = 0;  done < n;  done += XT_SPILL_BLOCK)
+    {
+        while (pS->count == XT_SPILL_QUEUE)
+            pthread_cond_wait (& pS->cond, & pS->lock);
+        i = (pS->head + pS->count++) % XT_SPILL_QUEUE;
+        memcpy (& pS->pQueue [(size_t) i * XT_SPILL_BLOCK], pMem + done, XT_SPILL_BLOCK);
+        pS->pOwner [i] = pSpill;
+        pthread_cond_broadcast (& pS->cond);
+    }
+    pthread_mutex_unlock (& pS->lock);
+
+    memmove (pMem, pMem + n, used - n);
+    return (n);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Create the temporary file and start the spill thread, the first time a block
+ * is spilled.  If this fails, the tree is kept in memory from then on.
+ * Returns 0 if the thread is running and -1 if not.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_SpillStart (void)
+{
+    XTSpiller   *pS = & xt_spiller;
+
+    if (pS->running == 1)
+        return (0);
+
+    memset (pS, 0, sizeof (XTSpiller));
+    pthread_mutex_init (& pS->lock, NULL);
+    pthread_cond_init (& pS->cond, NULL);
+    pS->pQueue = (unsigned char *) XT_CALLOC (XT_SPILL_QUEUE, XT_SPILL_BLOCK);
+    pS->pPacked = (unsigned char *) XT_CALLOC (1, XT_PACK_MAX (XT_SPILL_BLOCK));
+    if (pS->pQueue == NULL || pS->pPacked == NULL || (pS->fp = tmpfile ()) == NULL ||
+        pthread_create (& pS->thread, NULL, XT_SpillThread, pS) != 0)
+    {
+        if (pS->fp != NULL)
+            fclose (pS->fp);
+        XT_FREE (pS->pQueue);
+        XT_FREE (pS->pPacked);
+        pthread_mutex_destroy (& pS->lock);
+        pthread_cond_destroy (& pS->cond);
+        memset (pS, 0, sizeof (XTSpiller));
+        xt_spillBytes = 0;
+        fprintf (stderr, "Could not start spilling to disk.  Spilling disabled!\n");
+        return (-1);
+    }
+    pS->running = 1;
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The spill thread.  Writes each queued block in turn, leaving it in the queue
+ * until it has been written, and returns once the queue is empty after
+ * XT_SpillFinish() has asked it to stop.
+ */
+
+__attribute__ ((no_instrument_function))
+void *XT_SpillThread (void *pArg)
+{
+    unsigned     i;
+    XTSpiller   *pS = (XTSpiller *) pArg;
+
+    pthread_mutex_lock (& pS->lock);
+    for (;;)
+    {
+        while (pS->count == 0 && pS->stop == 0)
+            pthread_cond_wait (& pS->cond, & pS->lock);
+        if (pS->count == 0)
+            break;
+        i = pS->head;
+        pthread_mutex_unlock (& pS->lock);
+
+        XT_SpillWrite (pS->pOwner [i], & pS->pQueue [(size_t) i * XT_SPILL_BLOCK]);
+
+        pthread_mutex_lock (& pS->lock);
+        pS->head = (pS->head + 1) % XT_SPILL_QUEUE;
+        pS->count--;
+        pthread_cond_broadcast (& pS->cond);
+    }
+    pthread_mutex_unlock (& pS->lock);
+    return (NULL);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Compress a block and append it to the spill file, noting where it went in
+ * the array it came from.  A block that does not compress is stored as it is.
+ * Blocks are always written in order, so the nth block of an array is the nth
+ * entry of its pBlocks.  If the block cannot be written, failed is set and the
+ * tree will be printed with the block's nodes garbled.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SpillWrite (XTSpill *pSpill, const unsigned char *pData)
+{
+    size_t       size;
+    void        *p;
+    XTBlock     *pBlock;
+    XTSpiller   *pS = & xt_spiller;
+
+    if (pSpill->nBlocks >= pSpill->blocksSize)
+    {
+        size = (pSpill->blocksSize == 0) ? 256 : pSpill->blocksSize * 2;
+        if ((p = XT_REALLOC (pSpill->pBlocks, size * sizeof (XTBlock))) == NULL)
+        {
+            pS->failed = 1;
+            return;
+        }
+        pSpill->pBlocks = (XTBlock *) p;
+        pSpill->blocksSize = (unsigned) size;
+    }
+
+    pBlock = & pSpill->pBlocks [pSpill->nBlocks++];
+    pBlock->offset = pS->end;
+    pBlock->size = (unsigned) XT_Pack (pData, XT_SPILL_BLOCK, pS->pPacked);
+    pBlock->packed = (pBlock->size < XT_SPILL_BLOCK) ? 1 : 0;
+    if (pBlock->packed == 0)
+        pBlock->size = XT_SPILL_BLOCK;
+
+    if (pwrite (fileno (pS->fp), (pBlock->packed == 1) ? pS->pPacked : pData, pBlock->size,
+                (off_t) pBlock->offset) != (ssize_t) pBlock->size)
+        pS->failed = 1;
+    __atomic_store_n (& pS->end, pS->end + pBlock->size, __ATOMIC_RELAXED);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Wait for the spill thread to write all the queued blocks and stop it, before
+ * the tree is read back.  Nothing more is spilled after this.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SpillFinish (void)
+{
+    XTSpiller   *pS = & xt_spiller;
+
+    xt_spillBytes = 0;
+    if (pS->running == 0)
+        return;
+
+    pthread_mutex_lock (& pS->lock);
+    pS->stop = 1;
+    pthread_cond_broadcast (& pS->cond);
+    pthread_mutex_unlock (& pS->lock);
+    pthread_join (pS->thread, NULL);
+
+    pS->running = 0;
+    pthread_mutex_destroy (& pS->lock);
+    pthread_cond_destroy (& pS->cond);
+    XT_FREE (pS->pQueue);
+    XT_FREE (pS->pPacked);
+    pS->pQueue = pS->pPacked = NULL;
+    if (pS->failed == 1)
+        fprintf (stderr, "Could not spill the call tree to disk.  Parts of it are lost!\n");
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return a pointer to the byte at offset pos of a spilled array.  The block it
+ * is in is read back into this thread's cache, where it stays until another
+ * block replaces it, so reading nearby bytes costs little.  Each array has
+ * XT_SPILL_CACHE entries, a block always using the same one.  If the block
+ * cannot be read, it reads as zeros.
+ */
+
+__attribute__ ((no_instrument_function))
+const unsigned char *XT_SpillRead (const XTSpill *pSpill, size_t pos)
+{
+    unsigned         block = (unsigned) (pos / XT_SPILL_BLOCK);
+    const XTBlock   *pBlock;
+    XTCached        *pCached;
+    static const unsigned char  zero = 0;
+
+    pCached = & xt_spillCache [pSpill->cache + block % XT_SPILL_CACHE];
+    if (pCached->pData == NULL || pCached->pSpill != pSpill || pCached->block != block)
+    {
+        if (pCached->pData == NULL &&
+            (pCached->pData = (unsigned char *) XT_CALLOC (1, XT_SPILL_BLOCK)) == NULL)
+            return (& zero);
+        if (xt_pUnpack == NULL)
+            xt_pUnpack = (unsigned char *) XT_CALLOC (1, XT_PACK_MAX (XT_SPILL_BLOCK));
+
+        pCached->pSpill = pSpill;
+        pCached->block = block;
+        pBlock = (block < pSpill->nBlocks) ? & pSpill->pBlocks [block] : NULL;
+        if (pBlock == NULL || xt_pUnpack == NULL ||
+            pread (fileno (xt_spiller.fp), (pBlock->packed == 1) ? xt_pUnpack : pCached->pData,
+                   pBlock->size, (off_t) pBlock->offset) != (ssize_t) pBlock->size ||
+            (pBlock->packed == 1 &&
+             XT_Unpack (xt_pUnpack, pBlock->size, pCached->pData, XT_SPILL_BLOCK) != XT_SPILL_BLOCK))
+            memset (pCached->pData, 0, XT_SPILL_BLOCK);
+    }
+    return (& pCached->pData [pos % XT_SPILL_BLOCK]);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Release this thread's cache of spilled blocks.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_SpillFreeCache (void)
+{
+    unsigned   i;
+
+    for (i = 0;  i < 2 * XT_SPILL_CACHE;  i++)
+    {
+        XT_FREE (xt_spillCache [i].pData);
+        xt_spillCache [i].pData = NULL;
+    }
+    XT_FREE (xt_pUnpack);
+    xt_pUnpack = NULL;
+}
 
-    if (xt_nextBranch > 0)
+
+
+/*-----------------------------------------------------------------------------
+ * A small LZ77 block compressor.  The n bytes at pIn are written to pOut
+ * (which must hold XT_PACK_MAX (n) bytes) as a series of sequences, each some
+ * literal bytes copied as they are followed by a match, a copy of earlier
+ * output.  A sequence is a token byte holding the literal length in its top 4
+ * bits and the match length less 4 in its bottom 4, then the literals, then
+ * the match distance (2 bytes, low byte first).  A length of 15 in the token
+ * is continued in the bytes after it (after the token for the literals, after
+ * the distance for the match), each adding 0 to 255, up to the first that is
+ * not 255.  The last sequence has no match.  Matches are found through a hash
+ * table of the positions of earlier 4 byte strings.  Returns the size of the
+ * compressed data.
+ */
+
+__attribute__ ((no_instrument_function))
+size_t XT_Pack (const unsigned char *pIn, size_t n, unsigned char *pOut)
+{
+    uint32_t   table [XT_PACK_HASH], word;
+    size_t     i = 0, lit = 0, out = 0, at, len;
+
+    memset (table, 0, sizeof (table));          /* Position + 1 of each hash. */
+    while (i + 4 <= n)
     {
-        for (n = xt_nextBranch;  n != 0;  n--)    /* Scan all previous branches */
+        memcpy (& word, pIn + i, 4);
+        word = (word * 2654435761u) >> 20;
+        at = table [word];
+        table [word] = (uint32_t) i + 1;
+        if (at == 0 || i + 1 - at > 0xffff || memcmp (pIn + at - 1, pIn + i, 4) != 0)
         {
-            if (xt_pTree [n - 1].level < pBranch->level)
-            {
-                /* Found the last node added at the next highest level, so
-                 * firstly we store it as the parent of this node, then
-                 * tell it that this node is it's last child.
-                 */
-                pBranch->parent = n - 1;
-                xt_pTree [n - 1].lastChild = xt_nextBranch;
-                break;
-            }
+            i++;
+            continue;
         }
+
+        for (at--, len = 4;  i + len < n && pIn [at + len] == pIn [i + len];  len++)
+            ;
+        out += XT_PackSeq (pOut + out, pIn + lit, i - lit, i - at, len);
+        i += len;
+        lit = i;
     }
-    else
-         pBranch->parent = 0;    /* This should be the root i.e. main().*/
+    return (out + XT_PackSeq (pOut + out, pIn + lit, n - lit, 0, 0));
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * When pretty printing, lines are drawn using box characters. These characters
- * are defined in the unicode character set \u2500 to \u257f.  The characters
- * used are the vertical line (\u2502 or │), horizontal line (\u2500 or ─),
- * right-tee piece (\u251c or ├) and 'L' shaped piece (\u2514 or └). (For more
- * information see the web site https://jrgraphix.net/r/Unicode/2500-257F).
- * While these characters can be represented using the wchar_t variable type,
- * however, this is not portable and introduces a number of other issues (e.g.
- * functions like strlen() )..  The preferred method is to use UTF-8 coding
- * which encodes 16 bit unicode characters into a 3 byte codes as follows:
- * 1110-xxxx 10xx xxxx 10xx-xxxx.
+ * Write one sequence of XT_Pack() and return its size.  A len of 0 means
+ * there is no match.
  */
 
 __attribute__ ((no_instrument_function))
-void XT_PrintInit (void)
+size_t XT_PackSeq (unsigned char *pOut, const unsigned char *pLit, size_t nLit,
+                   size_t offset, size_t len)
 {
-    int          i;
-    static int   initialised = 0;
-    char        *p;
-    static char  h[] = {0xe2, 0x94, 0x80,      /* \u2500 -  ─  Horiz light   */
-                        0xe2, 0x94, 0x81,      /* \u2501             heavy   */
-                        0xe2, 0x95, 0x90};     /* \u2550             double  */
-    static char  v[] = {0xe2, 0x94, 0x82,      /* \u2502 -  │  Vert  light   */
-                        0xe2, 0x94, 0x83,      /* \u2503             heavy   */
-                        0xe2, 0x95, 0x91};     /* \u2551             double  */
-    static char  t[] = {0xe2, 0x94, 0x9c,      /* \u251c -  ├  tee   light   */
-                        0xe2, 0x94, 0xa0,      /* \u2520             heavy   */
-                        0xe2, 0x95, 0xa0};     /* \u2560             double  */
-    static char  l[] = {0xe2, 0x94, 0x94,      /* \u2514 -  └  L     light   */
-                        0xe2, 0x94, 0x97,      /* \u2517             heavy   */
-                        0xe2, 0x95, 0x9a};     /* \u255a             double  */
-    static char  j[] = {0xe2, 0x94, 0x98,      /* \u2518 -  ┘  J     light   */
-                        0xe2, 0x94, 0x9b,      /* \u251b             heavy   */
-                        0xe2, 0x95, 0x9d};     /* \u255d             double  */
-    static char  b[] = {0xe2, 0x94, 0x8c,      /* \u250c -  ┌  J     light   */
-                        0xe2, 0x94, 0x8f,      /* \u250f             heavy   */
-                        0xe2, 0x95, 0x94};     /* \u2554             double  */
-    XTType       g;
+    size_t    n, out = 1;
 
-    if (initialised == 0)
+    pOut [0] = (unsigned char) (((nLit < 15) ? nLit : 15) << 4);
+    if (len != 0)
+        pOut [0] |= (unsigned char) ((len - 4 < 15) ? len - 4 : 15);
+
+    if (nLit >= 15)
     {
-        g = xt_treeType;
+        for (n = nLit - 15;  n >= 255;  n -= 255)
+            pOut [out++] = 255;
+        pOut [out++] = (unsigned char) n;
+    }
+    memcpy (pOut + out, pLit, nLit);
+    out += nLit;
+    if (len == 0)
+        return (out);
+
+    pOut [out++] = (unsigned char) offset;
+    pOut [out++] = (unsigned char) (offset >> 8);
+    if (len - 4 >= 15)
+    {
+        for (n = len - 19;  n >= 255;  n -= 255)
+            pOut [out++] = 255;
+        pOut [out++] = (unsigned char) n;
+    }
+    return (out);
+}
 
-        p = xt_space;                             /* Build buffer with spaces only*/
-        for (i = 0; i < XT_INDENT + 1; i++)
-            *p++ = ' ';
-        *p = '\0';
 
-        if (xt_showTree == 1 || xt_traceLines == 1)
-        {
-            p = xt_vlinSpace;                     /* Build vertical line + spaces */
-            *p++ = v[g+0]; *p++ = v[g+1];*p++ = v[g+2];        /*  "│    "        */
-            for (i = 0; i < XT_INDENT; i++)
-                *p++ = ' ';
-            *p = '\0';
 
-            p = xt_teeHoriz;                      /* Build 't' piece + horiz lines */
-            *p++ = t[g+0];  *p++ = t[g+1];  *p++ = t[g+2];     /*  "├─── "         */
-            for (i = 0; i < XT_INDENT - 1; i++)
-            {
-                *p++ = h[g+0];
-                *p++ = h[g+1];
-                *p++ = h[g+2];
-            }
-            *p++ = ' ';
-            *p = '\0';
+/*-----------------------------------------------------------------------------
+ * Decompress the n bytes at pIn written by XT_Pack() into pOut, which holds
+ * size bytes.  Returns the number of bytes decompressed, or size + 1 if the
+ * data is not valid.
+ */
 
-            p = xt_LHoriz;                        /* Build 'L' piece + horiz lines */
-            *p++ = l[g+0];  *p++ = l[g+1];  *p++ = l[g+2];     /*  "└─── "         */
-            for (i = 0; i < XT_INDENT - 1; i++)
+__attribute__ ((no_instrument_function))
+size_t XT_Unpack (const unsigned char *pIn, size_t n, unsigned char *pOut, size_t size)
+{
+    unsigned   token, c;
+    size_t     i = 0, out = 0, len, offset;
+
+    while (i < n)
+    {
+        token = pIn [i++];
+        if ((len = token >> 4) == 15)
+            do
             {
-                *p++ = h[g+0];
-                *p++ = h[g+1];
-                *p++ = h[g+2];
+                if (i >= n)
+                    return (size + 1);
+                len += (c = pIn [i++]);
             }
-            *p++ = ' ';
-            *p = '\0';
-
-            p = xt_SHoriz;                        /* Build sideways 'S' piece       */
-            *p++ = b[g+0];  *p++ = b[g+1];  *p++ = b[g+2];     /*  "┌───┘ "         */
-            for (i = 0; i < XT_INDENT - 1; i++)
+            while (c == 255);
+        if (len > n - i || len > size - out)
+            return (size + 1);
+        memcpy (pOut + out, pIn + i, len);
+        i += len;
+        out += len;
+        if (i == n)
+            break;                              /* The last sequence.       */
+
+        if (n - i < 2)
+            return (size + 1);
+        offset = pIn [i] | (size_t) pIn [i + 1] << 8;
+        i += 2;
+        if ((len = (token & 15) + 4) == 19)
+            do
             {
-                *p++ = h[g+0];
-                *p++ = h[g+1];
-                *p++ = h[g+2];
+                if (i >= n)
+                    return (size + 1);
+                len += (c = pIn [i++]);
             }
-            *p++ = j[g+0];  *p++ = j[g+1];  *p++ = j[g+2];
-            *p = '\0';
+            while (c == 255);
+        if (offset == 0 || offset > out || len > size - out)
+            return (size + 1);
+        for (;  len > 0;  len--, out++)
+            pOut [out] = pOut [out - offset];
+    }
+    return (out);
+}
+
+#endif  /* XT_X_SPILL */
+
+
+
+#ifdef XT_X_CONTROL
+
+/*-----------------------------------------------------------------------------
+ * Open the control socket /tmp/xt-<pid>.sock and start the thread that serves
+ * it.  A socket left behind by an earlier process with the same id is removed
+ * first.  The space XT_ControlTop() sorts the function table in is allocated
+ * here, so that the thread's stack stays small.  Returns 0 on success and -1
+ * on failure.
+ */
+
+__attribute__ ((no_instrument_function))
+int XT_ControlInit (void)
+{
+    struct sockaddr_un  addr;
+    pthread_t           thread;
+
+    snprintf (xt_ctlPath, sizeof (xt_ctlPath), XT_CTL_PATH, (int) getpid ());
+    memset (& addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    strncpy (addr.sun_path, xt_ctlPath, sizeof (addr.sun_path) - 1);
+    unlink (xt_ctlPath);
+
+    xt_pCtlTop  = (unsigned *) XT_CALLOC (XT_FUNC_TABLE, sizeof (unsigned));
+    xt_pCtlSelf = (unsigned long long *) XT_CALLOC (XT_FUNC_TABLE, sizeof (unsigned long long));
+    if (xt_pCtlTop == NULL || xt_pCtlSelf == NULL ||
+        (xt_ctlFd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        XT_FREE (xt_pCtlTop);
+        XT_FREE (xt_pCtlSelf);
+        xt_pCtlTop = NULL;
+        xt_pCtlSelf = NULL;
+        return (-1);
+    }
+
+    if (bind (xt_ctlFd, (struct sockaddr *) & addr, sizeof (addr)) != 0 ||
+        listen (xt_ctlFd, 4) != 0 ||
+        pthread_create (& thread, NULL, XT_Control, NULL) != 0)
+    {
+        close (xt_ctlFd);
+        unlink (xt_ctlPath);
+        xt_ctlFd = -1;
+        XT_FREE (xt_pCtlTop);
+        XT_FREE (xt_pCtlSelf);
+        xt_pCtlTop = NULL;
+        xt_pCtlSelf = NULL;
+        return (-1);
+    }
+    pthread_detach (thread);
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * The control thread.  Each connection carries a single request line, which is
+ * answered before the connection is closed.  The thread runs until the program
+ * exits.
+ */
+
+__attribute__ ((no_instrument_function))
+void *XT_Control (void *pArg)
+{
+    int       fd;
+    ssize_t   len;
+    char      req [128];
+
+    UNUSED (pArg);
+
+    for (;;)
+    {
+        if ((fd = accept (xt_ctlFd, NULL, NULL)) < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            break;
         }
-        else
+        if ((len = read (fd, req, sizeof (req) - 1)) > 0)
         {
-            memset (xt_vlinSpace, ' ', XT_INDENT + 1);   xt_vlinSpace [XT_INDENT + 1] = '\0';
-            memset (xt_teeHoriz,  ' ', XT_INDENT + 1);   xt_teeHoriz [XT_INDENT + 1]  = '\0';
-            memset (xt_LHoriz,    ' ', XT_INDENT + 1);   xt_LHoriz [XT_INDENT + 1]    = '\0';
-            memset (xt_SHoriz,    ' ', XT_INDENT + 1);   xt_SHoriz [XT_INDENT + 1]    = '\0';
+            req [len] = '\0';
+            req [strcspn (req, "\r\n")] = '\0';
+            XT_ControlRequest (fd, req);
         }
+        close (fd);
+    }
+    return (NULL);
+}
 
-        initialised = 1;
+
+
+/*-----------------------------------------------------------------------------
+ * Answer one request.  The requests are:
+ *     stacks       The functions each thread is running, outermost first.
+ *     top [N]      The N functions with the most self time so far.
+ *     memory       The memory used by the library.
+ *     dropped      The number of events that could not be recorded.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ControlRequest (int fd, char *pReq)
+{
+    const char *pCmd;
+    char      *pArg, *pSave;
+    long       n;
+    unsigned   i;
+    unsigned long long  skipped = 0;
+
+    if ((pCmd = strtok_r (pReq, " \t", & pSave)) == NULL)
+        pCmd = "help";
+    pArg = strtok_r (NULL, " \t", & pSave);
+
+    if (strcmp (pCmd, "stacks") == 0)
+        XT_ControlStacks (fd);
+    else if (strcmp (pCmd, "top") == 0)
+    {
+        n = (pArg != NULL) ? strtol (pArg, NULL, 10) : XT_CTL_TOP;
+        XT_ControlTop (fd, (n > 0 && n < XT_FUNC_TABLE) ? (unsigned) n : XT_CTL_TOP);
+    }
+    else if (strcmp (pCmd, "memory") == 0)
+        XT_ControlMemory (fd);
+    else if (strcmp (pCmd, "dropped") == 0)
+    {
+        for (i = 0;  i < XT_FUNC_TABLE;  i++)
+            skipped += xt_pFuncTable [i].skipped;
+        XT_ControlSend (fd, "%12llu  calls deeper than the shadow stack (%d)\n",
+                        __atomic_load_n (& xt_dropFrames, __ATOMIC_RELAXED), XT_STACK_MAX);
+        XT_ControlSend (fd, "%12llu  calls to functions missing from the function table\n",
+                        __atomic_load_n (& xt_dropFuncs, __ATOMIC_RELAXED));
+        XT_ControlSend (fd, "%12llu  calls deeper than the tree can record (%u)\n",
+                        __atomic_load_n (& xt_dropNodes, __ATOMIC_RELAXED), XT_LEVEL_MAX);
+        XT_ControlSend (fd, "%12llu  calls absorbed by adaptive suppression\n", skipped);
+#ifdef XT_X_SAMPLE
+        XT_ControlSend (fd, "%12llu  samples of paths missing from the sample tree (%d)\n",
+                        __atomic_load_n (& xt_dropSamples, __ATOMIC_RELAXED), XT_SAMPLE_NODES);
+#endif
     }
+    else
+        XT_ControlSend (fd, "Requests: stacks | top [N] | memory | dropped\n");
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * This function retreives the current "time" based on the type specified by
- * the xt_timer variable.
- * NOTE:  While the clock_gettime() function can theoretically be used to measure
- * times down to the nS, it is only available on a handful of *NIX systems.
- * Also, Windows may or may not support more accurate timing functions than the
- * standard time() function, but I don't support it -- I don't do Windows!
+ * Format a reply and send it to the client.  send() is used with MSG_NOSIGNAL
+ * so that a client which goes away cannot kill the program with SIGPIPE.
  */
 
 __attribute__ ((no_instrument_function))
-double XT_GetTime (void)
+void XT_ControlSend (int fd, const char *pFmt, ...)
 {
-    double    secs = 0.0;
+    va_list   args;
+    char      buff [512];
+    int       len;
+
+    va_start (args, pFmt);
+    len = vsnprintf (buff, sizeof (buff), pFmt, args);
+    va_end (args);
+
+    if (len > 0)
+        send (fd, buff, (len < (int) sizeof (buff)) ? (size_t) len : sizeof (buff) - 1,
+              MSG_NOSIGNAL);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Send the shadow stack of every thread along with how long each function has
+ * been running.  The depth is read first and the frames below it copied, so a
+ * stack that changes while it is read may show a function that has just
+ * returned, but it never shows a frame that has not been written.
+ */
 
-    switch (xt_timer)
+__attribute__ ((no_instrument_function))
+void XT_ControlStacks (int fd)
+{
+    XTStack   *pStack;
+    unsigned   depth, i;
+    void      *fn;
+    double     now, enter;
+    Dl_info    info;
+    char      *pName;
+
+    now = XT_GetClock ();
+    for (pStack = __atomic_load_n (& xt_pStacks, __ATOMIC_ACQUIRE);  pStack != NULL;
+         pStack = pStack->pNext)
     {
-        case XT_TIMER_CPU:
-            secs = (double) clock () / (double) CLOCKS_PER_SEC;
-            break;
+        depth = __atomic_load_n (& pStack->depth, __ATOMIC_ACQUIRE);
+        XT_ControlSend (fd, "thread %ld  (depth %u)\n", pStack->tid, depth);
 
-        case XT_TIMER_ELAPSED:
-            {
-#ifdef _WIN32                /* Windows: - gettimeofday() not supported. */
-                time_t    t;
+        for (i = 0;  i < depth && i < XT_STACK_MAX;  i++)
+        {
+            fn = __atomic_load_n (& pStack->frame [i].fn, __ATOMIC_RELAXED);
+            __atomic_load (& pStack->frame [i].enterTime, & enter, __ATOMIC_RELAXED);
+            if (dladdr (fn, & info) == 0 || info.dli_sname == NULL)
+                info.dli_sname = "???";
+            pName = XT_DemangleName (info.dli_sname);
+            if (xt_sampleRate > 0)         /* Sampling keeps no times.  */
+                XT_ControlSend (fd, "    %s\n", (pName != NULL) ? pName : info.dli_sname);
+            else
+                XT_ControlSend (fd, "    %-40s %12.6f S\n",
+                                (pName != NULL) ? pName : info.dli_sname, now - enter);
+            XT_FREE (pName);
+        }
+        if (depth > XT_STACK_MAX)
+            XT_ControlSend (fd, "    ... %u more\n", depth - XT_STACK_MAX);
+    }
+}
 
-                t = time (NULL);
-                secs = (double) t;
-#else                        /* Linux/MacOS                              */
-                struct timeval   t;
 
-                gettimeofday (& t, NULL);
-                secs = t.tv_sec;
-                secs += (double) t.tv_usec / 1000000.0;
-#endif
-            }
-            break;
 
-        case XT_TIMER_DISABLED:
-        default:
-            break;
+/*-----------------------------------------------------------------------------
+ * Send the n functions with the most self time so far, largest first.  Only
+ * calls that have returned are included.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ControlTop (int fd, unsigned n)
+{
+    unsigned   i, j, k, nTop = 0;
+    unsigned  *top = xt_pCtlTop;
+    unsigned long long  *self = xt_pCtlSelf;
+    Dl_info    info;
+    char      *pName;
+
+    /* Insert each function into the sorted list top[] of at most n entries.
+     */
+    for (i = 0;  i < XT_FUNC_TABLE;  i++)
+    {
+        self [i] = __atomic_load_n (& xt_pFuncTable [i].liveSelf, __ATOMIC_RELAXED);
+        if (self [i] == 0)
+            continue;
+        for (j = nTop;  j > 0 && self [top [j - 1]] < self [i];  j--)
+            ;
+        if (j >= n)
+            continue;
+        for (k = (nTop < n) ? nTop++ : n - 1;  k > j;  k--)
+            top [k] = top [k - 1];
+        top [j] = i;
     }
 
-    return (secs);
+    XT_ControlSend (fd, "%14s %14s  %s\n", "calls", "self (S)", "function");
+    for (i = 0;  i < nTop;  i++)
+    {
+        if (dladdr (xt_pFuncTable [top [i]].addr, & info) == 0 || info.dli_sname == NULL)
+            info.dli_sname = "???";
+        pName = XT_DemangleName (info.dli_sname);
+        XT_ControlSend (fd, "%14llu %14.6f  %s\n",
+                        __atomic_load_n (& xt_pFuncTable [top [i]].liveCalls, __ATOMIC_RELAXED),
+                        (double) self [top [i]] / 1000000000.0,
+                        (pName != NULL) ? pName : info.dli_sname);
+        XT_FREE (pName);
+    }
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * This simple function outputs the elapsed time based on start and end values
- * assumed to be in seconds.
+ * Send the memory used by each of the library's data structures.  The sizes
+ * are read without a lock, so they may be slightly out of date.
  */
 
 __attribute__ ((no_instrument_function))
-void XT_PrintElapsedTime (double start, double end)
+void XT_ControlMemory (int fd)
 {
-    double    elapsedTime;
+    size_t     size [7], total = 0;
+    unsigned   i, nStacks = 0;
+    XTStack   *pStack;
+    static const char  *names [] = {"call tree", "function names", "name hash table",
+                                    "performance counters", "allocations",
+                                    "function table", "shadow stacks"};
+
+    for (pStack = __atomic_load_n (& xt_pStacks, __ATOMIC_ACQUIRE);  pStack != NULL;
+         pStack = pStack->pNext)
+        nStacks++;
+
+    size [0] = (xt_pLevel != NULL) ? (size_t) xt_levelsSize * sizeof (uint16_t) + xt_dataSize +
+               (size_t) xt_cpuSize * sizeof (unsigned long long) +
+               (size_t) xt_prunedSize * sizeof (XTPrune) +
+               (size_t) (xt_treeSize / XT_CHECK_NODES + 1) * sizeof (XTCheck) +
+               (size_t) xt_openSize * sizeof (XTOpen) + (size_t) xt_linesSize * sizeof (XTLine) : 0;
+    size [1] = (xt_funcNames != NULL) ? (size_t) xt_nameBuffSize : 0;
+    size [2] = (size_t) xt_nameHashSize * sizeof (unsigned) * 3 / 2;
+    size [3] = (size_t) xt_countsSize * xt_nCounters * sizeof (unsigned long long);
+    size [4] = (size_t) xt_allocsSize * sizeof (XTAlloc);
+    size [5] = XT_FUNC_TABLE * (sizeof (XTFunc) + sizeof (unsigned) + sizeof (unsigned long long));
+    size [6] = (size_t) nStacks * sizeof (XTStack);
+
+    for (i = 0;  i < 7;  i++)
+    {
+        XT_ControlSend (fd, "%14zu  %s\n", size [i], names [i]);
+        total += size [i];
+    }
+    XT_ControlSend (fd, "%14zu  total  (%u of %u tree nodes used, %u threads)\n", total,
+                    xt_nextBranch, (xt_pLevel != NULL) ? xt_treeSize : 0, nStacks);
+#ifdef XT_X_SPILL
+    XT_ControlSend (fd, "%14llu  call tree spilled to disk (%zu bytes before compression)\n",
+                    __atomic_load_n (& xt_spiller.end, __ATOMIC_RELAXED),
+                    xt_dataBase + (size_t) xt_levelBase * sizeof (uint16_t));
+#endif
+}
 
-    elapsedTime = end - start;
+#endif  /* XT_X_CONTROL */
 
-    if (elapsedTime > 1.0)
-        XT_OUT ("  [%.2f S]", elapsedTime);
-    else if (elapsedTime > 0.001)
-        XT_OUT ("  [%.2f mS]", elapsedTime * 1000.0);
-    else if (elapsedTime > 0.000001)
-        XT_OUT ("  [%.0f uS]", elapsedTime * 1000000.0);
-    else
-        XT_OUT ("  [%.0f nS]", elapsedTime * 1000000000.0);
+
+
+#ifdef XT_X_SHARED
+
+/*-----------------------------------------------------------------------------
+ * When the library is built as libxt.so, the options are read from environment
+ * variables by the first call, before anything else is done, so a program can
+ * be traced in any mode without being rebuilt.  The variables are named after
+ * the make file options with an XT_ prefix (e.g. XT_TIMER=2, XT_FLUSH=3), and
+ * XT_OUTPUT and XT_PROFILE give the names of the trace and profile files.  Any
+ * variable not set leaves its option unchanged.  ALLOCS is not available as it
+ * needs the program to be linked with the wrappers.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_Configure (void)
+{
+    const char  *p;
+    int          timer;
+
+    if ((p = getenv ("XT_OUTPUT")) != NULL && *p != '\0')
+        xt_pOutputFile = p;
+    if ((p = getenv ("XT_PROFILE")) != NULL && *p != '\0')
+        xt_pProfileFile = p;
+
+    xt_realTime       = (int) XT_EnvValue ("XT_REAL_TIME", xt_realTime);
+    xt_traceLines     = (int) XT_EnvValue ("XT_TRACE_LINES", xt_traceLines);
+    xt_showTree       = (int) XT_EnvValue ("XT_SHOW_TREE", xt_showTree);
+    xt_addGaps        = (int) XT_EnvValue ("XT_ADD_GAPS", xt_addGaps);
+    xt_adaptive       = (int) XT_EnvValue ("XT_ADAPTIVE", xt_adaptive);
+    xt_adaptBudget    =       XT_EnvValue ("XT_ADAPT_BUDGET", xt_adaptBudget);
+    xt_counters       = (int) XT_EnvValue ("XT_COUNTERS", xt_counters);
+    xt_flushDepth     = (int) XT_EnvValue ("XT_FLUSH", xt_flushDepth);
+    xt_pruneTime      =       XT_EnvValue ("XT_PRUNE", xt_pruneTime);
+    xt_control        = (int) XT_EnvValue ("XT_CONTROL", xt_control);
+    xt_printThreads   = (int) XT_EnvValue ("XT_THREADS", xt_printThreads);
+    xt_spillBudget    =       XT_EnvValue ("XT_SPILL", xt_spillBudget);
+    xt_hotPaths       = (unsigned) XT_EnvValue ("XT_HOT_PATHS", xt_hotPaths);
+    xt_sampleRate     = (unsigned) XT_EnvValue ("XT_SAMPLE", xt_sampleRate);
+    xt_elideTemplates = (int) XT_EnvValue ("XT_ELIDE", xt_elideTemplates);
+
+    timer = (int) XT_EnvValue ("XT_TIMER", xt_timer);
+    if (timer > (int) XT_TIMER_BOTH)
+    {
+        timer = XT_TIMER_DISABLED;
+        fprintf (stderr, "XT_TIMER must be 0 to 3.  Timer disabled!\n");
+    }
+    xt_timer = (XTTimer) timer;
 }
 
 
 
 /*-----------------------------------------------------------------------------
- * Release the memory associated with the function name strings as well as the memory
- * used to store each node of the call tree.
+ * Return the value of an environment variable holding a number, or def if it
+ * is not set.  A value that is not a number, or is negative, is reported and
+ * def is returned instead.
  */
 
 __attribute__ ((no_instrument_function))
-void XT_Cleanup (void)
+double XT_EnvValue (const char *pName, double def)
 {
-    if (xt_funcNames != NULL)
+    const char  *p;
+    char        *pEnd;
+    double       value;
+
+    if ((p = getenv (pName)) == NULL || *p == '\0')
+        return (def);
+
+    value = strtod (p, & pEnd);
+    if (*pEnd != '\0' || value < 0.0 || value > 2147483647.0)
     {
-        free (xt_funcNames);
-        xt_funcNames = NULL;
+        fprintf (stderr, "%s=%s is not valid.  Value ignored!\n", pName, p);
+        return (def);
     }
+    return (value);
+}
+
+#endif  /* XT_X_SHARED */
+
+
+
+#ifdef XT_X_ALLOCS
+
+/*-----------------------------------------------------------------------------
+ * Charge an allocation and/or release to the function currently running.
+ * Memory used before the tree exists, after it has been printed or while in
+ * real time mode is not charged to anything.
+ */
+
+__attribute__ ((no_instrument_function))
+void XT_ChargeAlloc (size_t bytes, size_t freed, unsigned count)
+{
+    XTAlloc   *pAlloc;
 
-    if (xt_pTree != NULL)
+    if (xt_allocs == 1 && xt_realTime == 0 && xt_pAllocs != NULL && xt_level > 0 &&
+        xt_exitNodeIndex < xt_allocsSize)
     {
-        free (xt_pTree);
-        xt_pTree = NULL;
+        pAlloc = & xt_pAllocs [xt_exitNodeIndex];
+        pAlloc->bytes += bytes;
+        pAlloc->freed += freed;
+        pAlloc->count += count;
     }
 }
 
+
+
+/*-----------------------------------------------------------------------------
+ * The allocator wrappers.  Linking with -Wl,--wrap=malloc (and so on) makes
+ * every call to malloc() in the program call __wrap_malloc() instead, while
+ * __real_malloc() refers to the C library's version.  The bytes released by
+ * free() and realloc() are taken from malloc_usable_size(), which may be a
+ * little more than the size originally requested.
+ */
+
+__attribute__ ((no_instrument_function))
+void *__wrap_malloc (size_t size)
+{
+    void   *p;
+
+    if ((p = __real_malloc (size)) != NULL)
+        XT_ChargeAlloc (size, 0, 1);
+    return (p);
+}
+
+
+__attribute__ ((no_instrument_function))
+void *__wrap_calloc (size_t n, size_t size)
+{
+    void   *p;
+
+    if ((p = __real_calloc (n, size)) != NULL)
+        XT_ChargeAlloc (n * size, 0, 1);
+    return (p);
+}
+
+
+__attribute__ ((no_instrument_function))
+void *__wrap_realloc (void *ptr, size_t size)
+{
+    void   *p;
+    size_t  old;
+
+    old = (ptr != NULL) ? malloc_usable_size (ptr) : 0;
+    if ((p = __real_realloc (ptr, size)) != NULL || size == 0)
+        XT_ChargeAlloc (size, old, (size != 0) ? 1 : 0);
+    return (p);
+}
+
+
+__attribute__ ((no_instrument_function))
+void __wrap_free (void *ptr)
+{
+    if (ptr != NULL)
+        XT_ChargeAlloc (0, malloc_usable_size (ptr), 0);
+    __real_free (ptr);
+}
+
+#endif  /* XT_X_ALLOCS */
+
 #endif  /* _X_TRACE__ */
@@ -28,19 +28,50 @@
 #ifdef _X_TRACE__                      /* Define in xt.c before including this file.      */
 
 
-#define _POSIX_C_SOURCE 2      // For popen) and pclose()
+#define _POSIX_C_SOURCE 200809L // For popen() pclose() and clock_gettime()
+#define _DEFAULT_SOURCE        // For syscall()
 
 #include <stdio.h>             // fprintf()  fopen() fclose() FILE stderr
 #include <string.h>            // strlen() strcpy() strncpy() strcat()
 #include <stdlib.h>            // calloc() realloc() free()
+#include <stdint.h>            // uintptr_t
+#include <malloc.h>            // malloc_usable_size()
 #define __USE_XOPEN
-#include <time.h>              // clock() CLOCKS_PER_SEC
+#include <time.h>              // clock_gettime() clockid_t
 
 #define __USE_GNU
 #include <dlfcn.h>             // dladdr()
 
 #ifndef _WIN32
-#include <sys/time.h>          // gettimeofday() struct timeval
+#include <sys/time.h>          // setitimer() struct itimerval
+#endif
+
+#ifdef __linux__
+#include <unistd.h>            // syscall() read() close() sysconf()
+#include <sys/ioctl.h>         // ioctl()
+#include <sys/mman.h>          // mmap() munmap()
+#include <sys/syscall.h>       // SYS_perf_event_open
+#include <linux/perf_event.h>  // struct perf_event_attr  perf_event_mmap_page
+#endif
+
+#ifdef XT_X_CONTROL
+#include <stdarg.h>            // va_list
+#include <sys/socket.h>        // socket() bind() listen() accept() send()
+#include <sys/un.h>            // struct sockaddr_un
+#endif
+
+#if defined (XT_X_CONTROL) || defined (XT_X_THREADS) || defined (XT_X_SPILL)
+#include <errno.h>             // errno EINTR
+#include <pthread.h>           // pthread_create() pthread_detach() pthread_join()
+#endif
+
+#ifdef XT_X_SAMPLE
+#include <signal.h>            // sigaction() SIGPROF
+#endif
+
+#ifdef XT_X_THREADS
+#include <sys/uio.h>           // writev() struct iovec
+#include <limits.h>            // IOV_MAX
 #endif
 
 
@@ -55,6 +86,32 @@
 #define _XT              __attribute__ ((no_instrument_function))
 
 #define XT_INDENT        4                    /* Indentation for each branch of the tree.*/
+#define XT_FUNC_TABLE    4096                 /* Function table entries (power of 2).    */
+#define XT_ADAPT_CALLS   1000                 /* Calls before adaptive mode judges.      */
+#define XT_NO_PARENT     0xffffffffu          /* Parent index of a root context.         */
+#define XT_COUNTERS      4                    /* Maximum performance counters per node.  */
+#define XT_FLUSH_MAX     64                   /* Deepest level that can be flushed.      */
+#define XT_HOLD_MAX      (16u << 20)          /* Bytes of flushed lines held back.       */
+#define XT_HOLD_BAR      '\001'               /* Marks a held vertical line.             */
+#define XT_HOLD_TEE      '\002'               /* Marks a held tee or 'L' piece.          */
+#define XT_PIECE_MAX     16                   /* Bytes of line prefix per tree level.    */
+#define XT_LEVEL_MAX     0xffffu              /* Deepest level recorded (16 bit levels).  */
+#define XT_CHECK_NODES   256                  /* Nodes between stream checkpoints.        */
+#define XT_WINDOW        4096                 /* Nodes decoded at a time when walking.    */
+#define XT_VAR_MAX       10                   /* Longest varint (64 bits).                */
+#define XT_STACK_MAX     256                  /* Deepest shadow stack kept per thread.   */
+#define XT_SPAN_MAX      64                   /* Spans that can be open at once.         */
+#define XT_CTL_PATH      "/tmp/xt-%d.sock"    /* Control socket name (%d is the pid).    */
+#define XT_CTL_TOP       10                   /* Default functions listed by "top".      */
+#define XT_PAR_NODES     65536                /* Smallest tree printed in parallel.      */
+#define XT_PAR_JOBS      8                    /* Jobs per print thread.                  */
+#define XT_PAR_DEPTH     16                   /* Deepest level a tree is split at.       */
+#define XT_SPILL_BLOCK   65536                /* Bytes per block spilled to disk.        */
+#define XT_SPILL_QUEUE   16                   /* Blocks waiting to be spilled.           */
+#define XT_SPILL_CACHE   4                    /* Spilled blocks cached per array/thread. */
+#define XT_PACK_HASH     4096                 /* Block compressor hash (power of 2).     */
+#define XT_PACK_MAX(n)   ((n) + (n) / 255 + 16) /* Largest compressed size of n bytes.   */
+#define XT_SAMPLE_NODES  65536                /* Distinct stacks kept when sampling.     */
 
 #define XT_COL_NORM      "\x1B[0m"
 #define XT_COL_RED       "\x1B[31m"
@@ -73,7 +130,35 @@
 #define XT_COL_RESET     XT_COL_NORM
 
 #define UNUSED(x)        (void)(x)
-#define XT_OUT(...)      fprintf(stderr, __VA_ARGS__)
+
+/* When allocations are being attributed (ALLOCS=1 in the make file), the
+ * program is linked with --wrap for malloc(), calloc(), realloc() and free(),
+ * which also applies to the calls made from this file.  The library's own
+ * memory must not be charged to the program (or recurse into the wrappers),
+ * so it always uses these macros to call the real functions directly.
+ */
+#ifdef XT_X_ALLOCS
+#define XT_CALLOC(n, s)  __real_calloc (n, s)
+#define XT_REALLOC(p, s) __real_realloc (p, s)
+#define XT_FREE(p)       __real_free (p)
+#else
+#define XT_CALLOC(n, s)  calloc (n, s)
+#define XT_REALLOC(p, s) realloc (p, s)
+#define XT_FREE(p)       free (p)
+#endif
+#define XT_OUT(...)      fprintf((xt_pOut != NULL) ? xt_pOut : xt_fp, __VA_ARGS__)
+#define XT_HOLD_MARK(p, level) (((p) [0] == XT_HOLD_TEE || (p) [0] == XT_HOLD_BAR) && (p) [1] == (char) (' ' + (level)))
+#define XT_REC_TIMED     0x01                 /* Calls are timed.                        */
+#define XT_REC_CPU       0x02                 /* CPU time kept (XT_TIMER_BOTH).          */
+#define XT_REC_PRUNE     0x04                 /* Short calls may be pruned.              */
+#define XT_REC_COUNTERS  0x08                 /* Performance counters read.              */
+#define XT_REC_ALLOCS    0x10                 /* Memory allocated is counted.            */
+#define XT_REC_PATHS     32                   /* Sets of flags (see XT_SelectHooks()).   */
+#ifdef XT_X_SAMPLE
+#define XT_NOW(timer)    (((timer) == XT_TIMER_SAMPLES) ? xt_sampleTicks : XT_GetTicks ())
+#else
+#define XT_NOW(timer)    XT_GetTicks ()
+#endif
 
 
 
@@ -91,21 +176,267 @@ typedef enum timer_
 {
     XT_TIMER_DISABLED,                        /* Timing information not printed.        */
     XT_TIMER_CPU,                             /* Print amount of CPU processing time.   */
-    XT_TIMER_ELAPSED                          /* Print clock time.                      */
+    XT_TIMER_ELAPSED,                         /* Print clock time.                      */
+    XT_TIMER_BOTH,                            /* Clock, thread CPU and off CPU time.    */
+    XT_TIMER_SAMPLES                          /* CPU time estimated from samples.       */
 }
 XTTimer;
 
-typedef struct xtbranch_
+typedef void (*XTHook) (void *this_fn);       /* Enter or exit path of the hooks.       */
+
+/* The call tree is recorded in a compact form (see xt.c).  The level of each
+ * node is kept in an array, and everything else goes into a byte stream of
+ * events in the order they happen.  A node's enter record holds its name and,
+ * when timing, the ticks since the previous event, and each exit is just the
+ * ticks since the previous event, all as varints.  Nodes are only fully
+ * decoded (into XTNode) when the tree is printed or saved.
+ */
+typedef struct xtopen_                        /* A recorded function still running.     */
 {
+    unsigned     index;                       /* Node index.                            */
+    size_t       offset;                      /* Offset of its enter record in stream.  */
+    unsigned long long  tick;                 /* Time of the event before it.           */
+}
+XTOpen;
+
+typedef struct xtcheck_                       /* Stream position of every               */
+{                                             /* XT_CHECK_NODES'th node.                */
+    size_t       offset;                      /* Offset of the node's enter record.     */
+    unsigned long long  tick;                 /* Time of the event before it.           */
+}
+XTCheck;
+
+typedef struct xtline_                        /* Line number of a node (only kept for   */
+{                                             /* the few nodes that have one).          */
+    unsigned     index;                       /* Node index.                            */
+    int          lineNo;                      /* Line number of call.                   */
+}
+XTLine;
+
+typedef struct xtnode_                        /* A node decoded from the stream.        */
+{
+    unsigned     index;                       /* Node index.                            */
     unsigned     level;                       /* Level in tree.                         */
-    unsigned     nameIndx;                    /* Index to name in sting array.          */
+    unsigned     nameIndx;                    /* Index to name in string array.         */
     int          lineNo;                      /* Line number of call if found.          */
-    double       enterTime;                   /* Clock ticks when entering function.    */
-    double       exitTime;                    /* Clock ticks when exiting function.     */
-    unsigned     lastChild;                   /* Index of last child.                   */
-    unsigned     parent;                      /* Index of parent object.                */
+    int          last;                        /* Set if last child of its parent.       */
+    int          leaf;                        /* Set if it has no children.             */
+    unsigned long long  enterTime;            /* Ticks when entering function.          */
+    unsigned long long  exitTime;             /* Ticks when exiting function.           */
+}
+XTNode;
+
+typedef struct xtsnap_                        /* Position reached by a walk.            */
+{
+    size_t       pos;                         /* Stream offset of the boundary.         */
+    unsigned long long  tick;                 /* Time of the event before pos.          */
+    unsigned     nExit;                       /* Exit events just before pos.           */
+    unsigned     seenTop;                     /* Highest level with seen set.           */
 }
-XTBranch;
+XTSnap;
+
+typedef struct xtwalk_                        /* State used to decode a range of nodes. */
+{
+    unsigned     first;                       /* First node of the range.               */
+    unsigned     end;                         /* One past the last node.                */
+    int          rootLast;                    /* Value of last for the first node.      */
+    unsigned     nLevels;                     /* Entries in the per level arrays.       */
+    unsigned     nWindows;                    /* Windows of XT_WINDOW nodes in range.   */
+    unsigned     window;                      /* Window held in pNodes.                 */
+    unsigned     next;                        /* Next node of the window to return.     */
+    unsigned     count;                       /* Nodes held in pNodes.                  */
+    unsigned     line;                        /* Next entry of xt_pLines to check.      */
+    XTSnap       at;                          /* Boundary reached.                      */
+    unsigned long long *pExit;                /* Exit time of open node at each level.  */
+    unsigned char *pSeen;                     /* Later sibling seen at each level.      */
+    XTSnap      *pSnap;                       /* Boundary at each window's end, and the */
+    unsigned long long *pSnapExit;            /* pExit and pSeen arrays there.          */
+    unsigned char *pSnapSeen;
+    XTNode      *pNodes;                      /* Decoded nodes of the current window.   */
+}
+XTWalk;
+
+typedef struct xtfunc_                        /* Per address statistics used by the     */
+{                                             /* adaptive suppression mode.             */
+    void        *addr;                        /* Function address (hash key).           */
+    unsigned     active;                      /* Recorded invocations currently open.   */
+    int          suppressed;                  /* Set once the function is suppressed.   */
+    unsigned long  calls;                     /* Outermost invocations completed.       */
+    unsigned long  skipped;                   /* Calls absorbed while suppressed.       */
+    double       firstCall;                   /* Clock when first seen.                 */
+    double       enterTime;                   /* Clock when outermost call started.     */
+    double       totalTime;                   /* Total time of outermost invocations.   */
+    unsigned long long  liveCalls;            /* Calls seen by the shadow stacks.       */
+    unsigned long long  liveSelf;             /* Self time (nS) seen by shadow stacks.  */
+}
+XTFunc;
+
+typedef struct xtalloc_                       /* Heap use charged to a node.            */
+{
+    unsigned long long  bytes;                /* Bytes allocated.                       */
+    unsigned long long  count;                /* Number of allocations.                 */
+    unsigned long long  freed;                /* Bytes released.                        */
+}
+XTAlloc;
+
+typedef struct xtprune_                       /* Short calls removed from below a node. */
+{
+    unsigned long long  calls;                /* Number of calls pruned.                */
+    unsigned long long  ticks;                /* Their total time (nS).                 */
+}
+XTPrune;
+
+typedef struct xtframe_                       /* Shadow stack entry for one call.       */
+{
+    void        *fn;                          /* Function address.                      */
+    double       enterTime;                   /* Clock when the function was entered.   */
+    double       childTime;                   /* Time spent in the functions it called. */
+}
+XTFrame;
+
+typedef struct xtstack_                       /* Shadow stack of one thread.            */
+{
+    struct xtstack_ *pNext;                   /* Next thread's stack (list of all).     */
+    long         tid;                         /* Kernel thread id.                      */
+    unsigned     depth;                       /* Functions running (may exceed max).    */
+    XTFrame      frame [XT_STACK_MAX];        /* Outermost function first.              */
+}
+XTStack;
+
+#ifdef XT_X_THREADS
+/* When a large tree is printed in parallel (XT_PrintParallel), it is split at
+ * a chosen depth.  Each node at that depth is printed along with its subtree
+ * by XT_WalkNext(), while the few nodes above it, the spine, are printed one
+ * by one.  Consecutive nodes are grouped into jobs, each printed into its own
+ * buffer by one of the print threads and written out in order.
+ */
+typedef struct xtspine_                       /* A node above the split depth.          */
+{
+    unsigned     index;                       /* Node index.                            */
+    unsigned     end;                         /* One past the last node of its subtree. */
+}
+XTSpine;
+
+typedef struct xtjob_                         /* A range of nodes printed by one thread.*/
+{
+    unsigned     first;                       /* First node (at or above split depth).  */
+    unsigned     end;                         /* One past the last node.                */
+    unsigned     spine;                       /* First spine entry at or after first.   */
+    unsigned     anc [XT_PAR_DEPTH];          /* Spine entry of each ancestor of first. */
+    char        *pOut;                        /* Printed text (NULL if out of memory).  */
+    size_t       len;                         /* Length of the text.                    */
+    int          done;                        /* Set once the job has been printed.     */
+}
+XTJob;
+
+typedef struct xtpool_                        /* State shared by the print threads.     */
+{
+    XTJob       *pJobs;                       /* Jobs in tree order.                    */
+    unsigned     nJobs;                       /* Number of jobs.                        */
+    unsigned     next;                        /* Next job to be printed.                */
+    unsigned     written;                     /* Jobs written out so far.               */
+    unsigned     ahead;                       /* Jobs allowed to wait to be written.    */
+    unsigned     depth;                       /* Level the tree is split at.            */
+    XTSpine     *pSpine;                      /* Nodes above the split depth.           */
+    const XTAlloc *pTotals;                   /* Allocation totals (or NULL).           */
+    pthread_mutex_t  lock;                    /* Protects next, written and done.       */
+    pthread_cond_t   cond;                    /* Signalled when any of these change.    */
+}
+XTPool;
+#endif
+
+#ifdef XT_X_SAMPLE
+/* When sampling, the stacks seen by the profiling timer are merged into a tree
+ * of these, where each node is a function called from the path above it.  The
+ * tree lives in one fixed array, node 0 being the root above every thread, so
+ * that the signal handler never allocates memory.
+ */
+typedef struct xtsample_                      /* A call path seen by the sampler.       */
+{
+    void        *fn;                          /* Function address.                      */
+    unsigned     parent;                      /* Node of its caller.                    */
+    unsigned     child;                       /* First function it called (0 if none).  */
+    unsigned     sibling;                     /* Next function called by its caller.    */
+    unsigned long long  count;                /* Samples taken while it was running.    */
+}
+XTSample;
+#endif
+
+#ifdef XT_X_SPILL
+/* The oldest part of the stream and of the level array can be spilled to a
+ * temporary file, in blocks of XT_SPILL_BLOCK bytes compressed by XT_Pack().
+ * The blocks are compressed and written by a background thread, and read back
+ * into a small cache (one per thread) when the tree is printed.
+ */
+typedef struct xtblock_                       /* A block spilled to disk.               */
+{
+    unsigned long long  offset;               /* Offset in the spill file.              */
+    unsigned     size;                        /* Bytes it takes in the file.            */
+    int          packed;                      /* 0 if stored as is (did not compress).  */
+}
+XTBlock;
+
+typedef struct xtspill_                       /* An array partly spilled to disk.       */
+{
+    XTBlock     *pBlocks;                     /* Its blocks in order.                   */
+    unsigned     nBlocks;                     /* Blocks written.                        */
+    unsigned     blocksSize;                  /* Entries allocated in pBlocks.          */
+    unsigned     cache;                       /* First xt_spillCache entry it uses.     */
+}
+XTSpill;
+
+typedef struct xtcached_                      /* A spilled block read back.             */
+{
+    unsigned char *pData;                     /* Its contents (NULL if not used yet).   */
+    const XTSpill *pSpill;                    /* Array and index of the block held.     */
+    unsigned     block;
+}
+XTCached;
+
+typedef struct xtspiller_                     /* State shared with the spill thread.    */
+{
+    FILE        *fp;                          /* Temporary file holding the blocks.     */
+    unsigned long long  end;                  /* Bytes written to it.                   */
+    unsigned char *pQueue;                    /* XT_SPILL_QUEUE blocks waiting.         */
+    XTSpill     *pOwner [XT_SPILL_QUEUE];     /* Array each waiting block belongs to.   */
+    unsigned     head;                        /* First waiting block.                   */
+    unsigned     count;                       /* Blocks waiting.                        */
+    unsigned char *pPacked;                   /* Compressed block being written.        */
+    int          running;                     /* Set while the thread runs.             */
+    int          stop;                        /* Set when no more blocks will come.     */
+    int          failed;                      /* Set if a block could not be written.   */
+    pthread_t    thread;
+    pthread_mutex_t  lock;                    /* Protects head, count and stop.         */
+    pthread_cond_t   cond;                    /* Signalled when any of these change.    */
+}
+XTSpiller;
+#endif
+
+typedef struct xtcontext_                     /* Calling context (unique call path)     */
+{                                             /* used when saving a profile.            */
+    unsigned     parent;                      /* Context of the calling function.       */
+    unsigned     nameIndx;                    /* Index to name in string array.         */
+    unsigned     next;                        /* Next context in hash chain (+1).       */
+    unsigned long  calls;                     /* Number of calls along this path.       */
+    double       total;                       /* Total time including called functions. */
+    double       self;                        /* Time spent in the function itself.     */
+    unsigned long long  counts [XT_COUNTERS]; /* Performance counter totals.            */
+    XTAlloc      alloc;                       /* Allocations including called funcs.    */
+    XTAlloc      selfAlloc;                   /* Allocations by the function itself.    */
+    XTPrune      pruned;                      /* Short calls pruned from its children.  */
+    double       cpu;                         /* Thread CPU time (XT_TIMER_BOTH).       */
+    double       selfCpu;                     /* Thread CPU time of the function itself.*/
+}
+XTContext;
+
+typedef struct xtevent_                       /* Performance counter description.       */
+{
+    unsigned     type;                        /* perf_event_attr type and config used   */
+    unsigned long long  config;               /* to open the counter.                   */
+    const char  *pName;                       /* Field name used in profiles.           */
+    const char  *pLabel;                      /* Label used when printing the tree.     */
+}
+XTEvent;
 
 
 
@@ -117,15 +448,155 @@ XTBranch;
 void      __cyg_profile_func_enter (void *this_fn, void *call_site)  __attribute__ ((no_instrument_function));
 void      __cyg_profile_func_exit  (void *this_fn, void *call_site)  __attribute__ ((no_instrument_function));
 
-void      XT_Trace              (const char *func)                   __attribute__ ((no_instrument_function));
+void      XT_EnterFirst         (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_SelectHooks        (void)                               __attribute__ ((no_instrument_function));
+void      XT_EnterAny           (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_ExitAny            (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_Disable            (void)                               __attribute__ ((no_instrument_function));
+void      XT_HookNone           (void *this_fn)                      __attribute__ ((no_instrument_function));
+static inline void XT_EnterNode (void *this_fn, unsigned flags)      __attribute__ ((always_inline, no_instrument_function));
+static inline void XT_ExitNode  (unsigned flags)                     __attribute__ ((always_inline, no_instrument_function));
+static inline void XT_EnterPrinted (void *this_fn, int timed, int lines) __attribute__ ((always_inline, no_instrument_function));
+static inline void XT_ExitPrinted  (int lines)                       __attribute__ ((always_inline, no_instrument_function));
+void      XT_EnterIndent        (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_EnterIndentTimed   (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_EnterLines         (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_EnterLinesTimed    (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_ExitIndent         (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_ExitLines          (void *this_fn)                      __attribute__ ((no_instrument_function));
+#ifdef XT_X_SHARED
+void      XT_Configure          (void)                               __attribute__ ((no_instrument_function));
+double    XT_EnvValue           (const char *pName, double def)      __attribute__ ((no_instrument_function));
+#endif
+
+void      XT_Trace              (const char *func, unsigned *pId)    __attribute__ ((no_instrument_function));
+void      XT_Return             (void)                               __attribute__ ((no_instrument_function));
+static inline void XT_PrintEnter (const char *func, int timed, int lines) __attribute__ ((always_inline, no_instrument_function));
+static inline void XT_PrintExit  (int lines)                       __attribute__ ((always_inline, no_instrument_function));
+void      XT_Close              (void)                               __attribute__ ((no_instrument_function));
 void      XT_Print              (void)                               __attribute__ ((no_instrument_function));
-void      XT_AddBranch          (const char *p, unsigned level)      __attribute__ ((no_instrument_function));
+void      XT_PrintRange         (unsigned first, unsigned end, int rootLast) __attribute__ ((no_instrument_function));
+void      XT_PrintNode          (const XTNode *pNode, int running, const XTAlloc *pTotal) __attribute__ ((no_instrument_function));
+int       XT_PrintReserve       (unsigned level)                     __attribute__ ((no_instrument_function));
+void      XT_FlushEnter         (unsigned level)                     __attribute__ ((no_instrument_function));
+void      XT_FlushExit          (unsigned index)                     __attribute__ ((no_instrument_function));
+void      XT_FlushPending       (int last)                           __attribute__ ((no_instrument_function));
+void      XT_HoldAdd            (const char *pLines, size_t len)     __attribute__ ((no_instrument_function));
+void      XT_HoldResolve        (unsigned level, int last)           __attribute__ ((no_instrument_function));
+const char *XT_HoldPiece        (char c, int last)                   __attribute__ ((no_instrument_function));
+void      XT_HoldGuess          (void)                               __attribute__ ((no_instrument_function));
+void      XT_HoldPut            (const char *pLines, size_t len)     __attribute__ ((no_instrument_function));
+void      XT_HoldWrite          (int all)                            __attribute__ ((no_instrument_function));
+void      XT_AddBranch          (const char *p, unsigned *pId, unsigned level) __attribute__ ((no_instrument_function));
+void      XT_CloseBranch        (unsigned level)                     __attribute__ ((no_instrument_function));
+unsigned  XT_RecordFlags        (void)                               __attribute__ ((no_instrument_function));
+static inline void XT_AddNode   (const char *p, unsigned *pId, unsigned level, XTTimer timer, unsigned flags) __attribute__ ((always_inline, no_instrument_function));
+static inline void XT_CloseNode (unsigned level, XTTimer timer, unsigned flags) __attribute__ ((always_inline, no_instrument_function));
+int       XT_Prune              (unsigned index, unsigned level, unsigned long long now) __attribute__ ((no_instrument_function));
+int       XT_TreeReserve        (unsigned level)                     __attribute__ ((no_instrument_function));
 unsigned  XT_AddFunctionName    (const char *p)                      __attribute__ ((no_instrument_function));
-void      XT_LinkToParent       (XTBranch *pBranch)                  __attribute__ ((no_instrument_function));
+unsigned  XT_NameIndex          (unsigned id)                        __attribute__ ((no_instrument_function));
+void      XT_Demangle           (void)                               __attribute__ ((no_instrument_function));
+char     *XT_DemangleName       (const char *pName)                  __attribute__ ((no_instrument_function));
+void      XT_ElideTemplates     (char *pName)                        __attribute__ ((no_instrument_function));
+void      XT_SetLine            (unsigned index, int lineNo)         __attribute__ ((no_instrument_function));
+void      XT_Rewind             (unsigned index)                     __attribute__ ((no_instrument_function));
+unsigned  XT_PutVar             (unsigned char *p, unsigned long long value) __attribute__ ((no_instrument_function));
+unsigned long long XT_GetVar    (size_t *pPos)                       __attribute__ ((no_instrument_function));
+unsigned long long XT_BackVar   (size_t *pPos)                       __attribute__ ((no_instrument_function));
+unsigned  XT_DataByte           (size_t pos)                         __attribute__ ((no_instrument_function));
+unsigned  XT_Level              (unsigned index)                     __attribute__ ((no_instrument_function));
+void      XT_Seek               (unsigned index, size_t *pPos, unsigned long long *pTick) __attribute__ ((no_instrument_function));
+void      XT_ReadNode           (unsigned index, XTNode *pNode)      __attribute__ ((no_instrument_function));
+void      XT_ReadTimes          (XTNode *pNode, unsigned end)        __attribute__ ((no_instrument_function));
+int       XT_WalkInit           (XTWalk *pWalk, unsigned first, unsigned end, int rootLast) __attribute__ ((no_instrument_function));
+const XTNode *XT_WalkNext       (XTWalk *pWalk)                      __attribute__ ((no_instrument_function));
+void      XT_WalkBack           (XTWalk *pWalk, unsigned index, XTNode *pNode) __attribute__ ((no_instrument_function));
+void      XT_WalkFree           (XTWalk *pWalk)                      __attribute__ ((no_instrument_function));
 void      XT_PrintInit          (void)                               __attribute__ ((no_instrument_function));
 double    XT_GetTime            (void)                               __attribute__ ((no_instrument_function));
+unsigned long long XT_GetTicks  (void)                               __attribute__ ((no_instrument_function));
+unsigned long long XT_GetCpuTicks (void)                             __attribute__ ((no_instrument_function));
+void      XT_PrintCpuTime       (unsigned long long wall, unsigned long long cpu) __attribute__ ((no_instrument_function));
 void      XT_PrintElapsedTime   (double start, double end)           __attribute__ ((no_instrument_function));
 void      XT_Cleanup            (void)                               __attribute__ ((no_instrument_function));
+XTFunc   *XT_FindFunction       (void *addr)                         __attribute__ ((no_instrument_function));
+void      XT_AdaptInit          (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_AdaptExit          (XTFunc *pFunc)                      __attribute__ ((no_instrument_function));
+double    XT_GetClock           (void)                               __attribute__ ((no_instrument_function));
+void      XT_PrintSuppressed    (void)                               __attribute__ ((no_instrument_function));
+XTContext *XT_Contexts          (unsigned *pCount)                   __attribute__ ((no_instrument_function));
+void      XT_SaveProfile        (void)                               __attribute__ ((no_instrument_function));
+void      XT_PrintHotPaths      (void)                               __attribute__ ((no_instrument_function));
+void      XT_PrintCriticalPath  (void)                               __attribute__ ((no_instrument_function));
+int       XT_CountersInit       (void)                               __attribute__ ((no_instrument_function));
+void      XT_ReadCounters       (unsigned long long *pValue)         __attribute__ ((no_instrument_function));
+void      XT_PrintCounters      (const unsigned long long *pValue)   __attribute__ ((no_instrument_function));
+XTAlloc  *XT_AllocTotals        (unsigned first, unsigned end)       __attribute__ ((no_instrument_function));
+void      XT_PrintAllocs        (const XTAlloc *pTotal, const XTAlloc *pSelf) __attribute__ ((no_instrument_function));
+XTStack  *XT_StackInit          (void)                               __attribute__ ((no_instrument_function));
+void      XT_StackPush          (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_StackPop           (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_Finish             (void)                               __attribute__ ((no_instrument_function));
+
+#ifdef XT_X_SAMPLE
+int       XT_SampleInit         (void)                               __attribute__ ((no_instrument_function));
+void      XT_SamplePush         (void *this_fn)                      __attribute__ ((no_instrument_function));
+unsigned  XT_SamplePop          (void)                               __attribute__ ((no_instrument_function));
+void      XT_ExitSample         (void *this_fn)                      __attribute__ ((no_instrument_function));
+void      XT_SampleSignal       (int sig)                            __attribute__ ((no_instrument_function));
+unsigned  XT_SampleChild        (unsigned parent, void *fn)          __attribute__ ((no_instrument_function));
+void      XT_SampleTree         (void)                               __attribute__ ((no_instrument_function));
+#endif
+
+#ifdef XT_X_THREADS
+int       XT_PrintParallel      (void)                               __attribute__ ((no_instrument_function));
+unsigned  XT_PrintDepth         (unsigned target)                    __attribute__ ((no_instrument_function));
+void     *XT_PrintWorker        (void *pArg)                         __attribute__ ((no_instrument_function));
+void      XT_PrintJob           (const XTPool *pPool, XTJob *pJob)   __attribute__ ((no_instrument_function));
+int       XT_WriteAll           (int fd, struct iovec *pIov, int n)  __attribute__ ((no_instrument_function));
+#endif
+
+#ifdef XT_X_SPILL
+size_t    XT_Spill              (XTSpill *pSpill, unsigned char *pMem, size_t used, size_t grow) __attribute__ ((no_instrument_function));
+int       XT_SpillStart         (void)                               __attribute__ ((no_instrument_function));
+void     *XT_SpillThread        (void *pArg)                         __attribute__ ((no_instrument_function));
+void      XT_SpillWrite         (XTSpill *pSpill, const unsigned char *pData) __attribute__ ((no_instrument_function));
+void      XT_SpillFinish        (void)                               __attribute__ ((no_instrument_function));
+const unsigned char *XT_SpillRead (const XTSpill *pSpill, size_t pos) __attribute__ ((no_instrument_function));
+void      XT_SpillFreeCache     (void)                               __attribute__ ((no_instrument_function));
+size_t    XT_Pack               (const unsigned char *pIn, size_t n, unsigned char *pOut) __attribute__ ((no_instrument_function));
+size_t    XT_PackSeq            (unsigned char *pOut, const unsigned char *pLit, size_t nLit,
+                                 size_t offset, size_t len)          __attribute__ ((no_instrument_function));
+size_t    XT_Unpack             (const unsigned char *pIn, size_t n, unsigned char *pOut, size_t size) __attribute__ ((no_instrument_function));
+#endif
+
+#ifdef XT_X_CONTROL
+int       XT_ControlInit        (void)                               __attribute__ ((no_instrument_function));
+void     *XT_Control            (void *pArg)                         __attribute__ ((no_instrument_function));
+void      XT_ControlRequest     (int fd, char *pReq)                 __attribute__ ((no_instrument_function));
+void      XT_ControlSend        (int fd, const char *pFmt, ...)      __attribute__ ((no_instrument_function, format (printf, 2, 3)));
+void      XT_ControlStacks      (int fd)                             __attribute__ ((no_instrument_function));
+void      XT_ControlTop         (int fd, unsigned n)                 __attribute__ ((no_instrument_function));
+void      XT_ControlMemory      (int fd)                             __attribute__ ((no_instrument_function));
+#endif
+
+/* Provided by the C++ runtime (libstdc++) when the program is linked with g++.
+ * It is weak so that C programs still link, in which case it is NULL.
+ */
+char     *__cxa_demangle        (const char *pName, char *pBuff, size_t *pLen, int *pStatus) __attribute__ ((weak));
+
+#ifdef XT_X_ALLOCS
+void     *__real_malloc         (size_t size);
+void     *__real_calloc         (size_t n, size_t size);
+void     *__real_realloc        (void *ptr, size_t size);
+void      __real_free           (void *ptr);
+void     *__wrap_malloc         (size_t size)                        __attribute__ ((no_instrument_function));
+void     *__wrap_calloc         (size_t n, size_t size)              __attribute__ ((no_instrument_function));
+void     *__wrap_realloc        (void *ptr, size_t size)             __attribute__ ((no_instrument_function));
+void      __wrap_free           (void *ptr)                          __attribute__ ((no_instrument_function));
+void      XT_ChargeAlloc        (size_t bytes, size_t freed, unsigned count) __attribute__ ((no_instrument_function));
+#endif
 
 
 #else
@@ -133,4 +604,49 @@ void      XT_Cleanup            (void)                               __attribute
 #define _            {(void)(cygln__);}
 
 #endif  /* _X_TRACE__ */
+
+
+/* Spans time a region inside a function, such as one pass of a loop, as if it
+ * were a function of its own, so it becomes a child node in the call tree.  A
+ * span is started with XT_SPAN_BEGIN("name") and ended with XT_SPAN_END()
+ * before the function returns, or XT_SPAN("name") starts one that ends when
+ * the enclosing block is left.  The name must be a string literal.  Its id is
+ * kept in a static variable at the call site, so the name is only looked up
+ * the first time the span is reached.  Spans are only recorded in programs
+ * built with "make USE_XT=1", which defines XT_X_ENABLED.  Otherwise the macros
+ * compile to nothing.
+ */
+typedef struct xtspan_                        /* A span that has been started.          */
+{
+    unsigned     level;                       /* Levels open once started, 0 if not.    */
+    unsigned    *pId;                         /* Name id at its call site (its tag).    */
+}
+XTSpan;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+XTSpan    XT_SpanScope          (const char *pName, unsigned *pId)   __attribute__ ((no_instrument_function));
+void      XT_SpanEnd            (void)                               __attribute__ ((no_instrument_function));
+void      XT_SpanCleanup        (XTSpan *pSpan)                      __attribute__ ((no_instrument_function));
+#ifdef __cplusplus
+}
+#endif
+
+/* XT_SPAN() is a single declaration, so it cannot be the body of an if
+ * statement without braces, and the span it starts is the one its cleanup
+ * ends.
+ */
+#ifdef XT_X_ENABLED
+#define XT_SPAN_BEGIN(name)  do { static unsigned xt_spanId = 0;  (void) XT_SpanScope ("" name, & xt_spanId); } while (0)
+#define XT_SPAN_END()        XT_SpanEnd ()
+#define XT_SPAN(name)        XTSpan XT_SPAN_VAR (__LINE__) __attribute__ ((cleanup (XT_SpanCleanup), unused)) = \
+                             __extension__ ({ static unsigned xt_spanId = 0;  XT_SpanScope ("" name, & xt_spanId); })
+#define XT_SPAN_VAR(line)    XT_SPAN_VAR2 (line)
+#define XT_SPAN_VAR2(line)   xt_span_##line
+#else
+#define XT_SPAN_BEGIN(name)  ((void) 0)
+#define XT_SPAN_END()        ((void) 0)
+#define XT_SPAN(name)        ((void) 0)
+#endif
 #endif  /* _XT_H_ */
@@ -0,0 +1,322 @@
+/*
+ * xtprof.c
+ *  Reading and writing of Execution Trace profile files (xt tools).
+ *  Copyright (C) 2020  Peter Harris   dilbert351@gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#define _POSIX_C_SOURCE 200809L // For getline() and strdup()
+
+#include <stdio.h>             // fopen() fclose() fprintf() getline()
+#include <string.h>            // strcmp() strncmp() strlen() strrchr() strdup() strtok_r()
+#include <stdlib.h>            // calloc() realloc() free() strtod()
+#include "xtprof.h"
+
+
+
+
+/*-----------------------------------------------------------------------------
+ * Read a profile file and add its contents to the profile pProf, which must
+ * either be zeroed or hold the result of earlier reads.  Fields are matched by
+ * name and paths by their text, so reading several files into one profile
+ * merges them.  Returns 0 on success and -1 if the file could not be read, is
+ * not a profile, names more than XT_PROF_FIELDS fields or has a line that does
+ * not hold a value for each field named, each followed by one space, and then
+ * the path.  As names may hold spaces, the rest of the line is the path.
+ */
+
+int XT_ProfRead (const char *pFile, XTProfile *pProf)
+{
+    FILE         *fp;
+    char         *pLine = NULL, *p, *pEnd, *pSave;
+    size_t        size = 0;
+    ssize_t       len;
+    unsigned      i, nFields = 0;
+    int           map [XT_PROF_FIELDS], rtn = -1;
+    double        value [XT_PROF_FIELDS];
+    XTProfEntry  *pEntry;
+
+    if ((fp = fopen (pFile, "r")) == NULL)
+        return (-1);
+
+    /* The first line must identify the file, the second names the fields.
+     */
+    if (getline (& pLine, & size, fp) <= 0 ||
+        strncmp (pLine, XT_PROF_MAGIC, strlen (XT_PROF_MAGIC)) != 0 ||
+        getline (& pLine, & size, fp) <= 0 ||
+        strncmp (pLine, XT_PROF_FLDHDR, strlen (XT_PROF_FLDHDR)) != 0)
+        goto done;
+
+    p = pLine + strlen (XT_PROF_FLDHDR);
+    while ((p = strtok_r (p, " \t\n", & pSave)) != NULL)
+    {
+        if (nFields >= XT_PROF_FIELDS || (map [nFields++] = XT_ProfField (pProf, p, 1)) < 0)
+            goto done;
+        p = NULL;
+    }
+
+    while ((len = getline (& pLine, & size, fp)) > 0)
+    {
+        if (pLine [len - 1] == '\n')
+            pLine [len - 1] = '\0';
+        if (pLine [0] == '#' || pLine [0] == '\0')
+            continue;
+
+        /* Exactly nFields values, each followed by a single space, then the
+         * rest of the line is the path, whatever it starts with.
+         */
+        p = pLine;
+        for (i = 0;  i < nFields;  i++)
+        {
+            value [i] = strtod (p, & pEnd);
+            if (pEnd == p || *pEnd != ' ')
+                break;
+            p = pEnd + 1;
+        }
+        if (i < nFields || *p == '\0')
+            goto done;                      /* Too few values, or no path.  */
+
+        if ((pEntry = XT_ProfFind (pProf, p, 1)) == NULL)
+            goto done;
+        for (i = 0;  i < nFields;  i++)
+            pEntry->value [map [i]] += value [i];
+    }
+    rtn = 0;
+
+done:
+    free (pLine);
+    fclose (fp);
+    return (rtn);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Add the profile pSrc to the profile pDst, which must either be zeroed or
+ * hold earlier results.  Fields and paths are matched in the same way as by
+ * XT_ProfRead(), and paths new to pDst are added after its own in the order
+ * they appear in pSrc.  Returns 0 on success and -1 if there is not enough
+ * memory or there are too many fields.
+ */
+
+int XT_ProfMerge (XTProfile *pDst, const XTProfile *pSrc)
+{
+    unsigned      i, n;
+    int           map [XT_PROF_FIELDS];
+    XTProfEntry  *pEntry;
+
+    for (i = 0;  i < pSrc->nFields;  i++)
+        if ((map [i] = XT_ProfField (pDst, pSrc->field [i], 1)) < 0)
+            return (-1);
+
+    for (n = 0;  n < pSrc->nEntries;  n++)
+    {
+        if ((pEntry = XT_ProfFind (pDst, pSrc->pEntry [n].pPath, 1)) == NULL)
+            return (-1);
+        for (i = 0;  i < pSrc->nFields;  i++)
+            pEntry->value [map [i]] += pSrc->pEntry [n].value [i];
+    }
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Write a profile in the standard format.  Entries are written in the order
+ * they were first added, which keeps callers ahead of the functions they call.
+ * As in the files written by the xt library, times have nine decimal places
+ * and all other fields, which are counts, are written as whole numbers.
+ */
+
+int XT_ProfWrite (FILE *fp, const XTProfile *pProf)
+{
+    unsigned   i, n;
+
+    fprintf (fp, "%s\n%s", XT_PROF_MAGIC, XT_PROF_FLDHDR);
+    for (i = 0;  i < pProf->nFields;  i++)
+        fprintf (fp, " %s", pProf->field [i]);
+    fprintf (fp, "\n");
+
+    for (n = 0;  n < pProf->nEntries;  n++)
+    {
+        for (i = 0;  i < pProf->nFields;  i++)
+            fprintf (fp, XT_ProfIsTime (pProf->field [i]) ? "%.9f " : "%.0f ",
+                     pProf->pEntry [n].value [i]);
+        fprintf (fp, "%s\n", pProf->pEntry [n].pPath);
+    }
+    return (ferror (fp) ? -1 : 0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Find the entry for a call path.  If it is not found and add is non zero, a
+ * new entry with all fields set to zero is created.  The hash table is doubled
+ * whenever it becomes more than half full.  Returns NULL if the path was not
+ * found (or could not be added).
+ */
+
+XTProfEntry *XT_ProfFind (XTProfile *pProf, const char *pPath, int add)
+{
+    unsigned      h, i, n, *pHash;
+    const char   *p;
+    XTProfEntry  *pEntry;
+
+    for (h = 5381, p = pPath;  *p != '\0';  p++)
+        h = h * 33 + (unsigned char) *p;
+
+    if (pProf->pHash != NULL)
+    {
+        for (i = pProf->pHash [h & (pProf->nHash - 1)];  i != 0;  i = pEntry->next)
+        {
+            pEntry = & pProf->pEntry [i - 1];
+            if (strcmp (pEntry->pPath, pPath) == 0)
+                return (pEntry);
+        }
+    }
+    if (add == 0)
+        return (NULL);
+
+    if (pProf->nEntries >= pProf->size)         /* Room for one more entry? */
+    {
+        n = (pProf->size == 0) ? 1024 : pProf->size * 2;
+        pEntry = (XTProfEntry *) realloc (pProf->pEntry, (size_t) n * sizeof (XTProfEntry));
+        if (pEntry == NULL)
+            return (NULL);
+        pProf->pEntry = pEntry;
+        pProf->size = n;
+    }
+
+    if (pProf->nEntries * 2 >= pProf->nHash)    /* Grow and rehash.         */
+    {
+        n = (pProf->nHash == 0) ? 2048 : pProf->nHash * 2;
+        if ((pHash = (unsigned *) calloc ((size_t) n, sizeof (unsigned))) == NULL)
+            return (NULL);
+        free (pProf->pHash);
+        pProf->pHash = pHash;
+        pProf->nHash = n;
+        for (i = 0;  i < pProf->nEntries;  i++)
+        {
+            pEntry = & pProf->pEntry [i];
+            for (h = 5381, p = pEntry->pPath;  *p != '\0';  p++)
+                h = h * 33 + (unsigned char) *p;
+            pEntry->next = pHash [h & (n - 1)];
+            pHash [h & (n - 1)] = i + 1;
+        }
+        for (h = 5381, p = pPath;  *p != '\0';  p++)
+            h = h * 33 + (unsigned char) *p;
+    }
+
+    pEntry = & pProf->pEntry [pProf->nEntries];
+    memset (pEntry, 0, sizeof (XTProfEntry));
+    if ((pEntry->pPath = strdup (pPath)) == NULL)
+        return (NULL);
+    pEntry->next = pProf->pHash [h & (pProf->nHash - 1)];
+    pProf->pHash [h & (pProf->nHash - 1)] = ++pProf->nEntries;
+    return (pEntry);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return the index of the named field, adding it if add is non zero.  Returns
+ * -1 if the field does not exist (or there is no room to add it).
+ */
+
+int XT_ProfField (XTProfile *pProf, const char *pName, int add)
+{
+    unsigned   i;
+
+    for (i = 0;  i < pProf->nFields;  i++)
+        if (strcmp (pProf->field [i], pName) == 0)
+            return ((int) i);
+
+    if (add == 0 || pProf->nFields >= XT_PROF_FIELDS)
+        return (-1);
+
+    strncpy (pProf->field [i], pName, XT_PROF_NAMELEN - 1);
+    pProf->nFields++;
+    return ((int) i);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Release all memory used by a profile and leave it zeroed ready for reuse.
+ */
+
+void XT_ProfFree (XTProfile *pProf)
+{
+    unsigned   i;
+
+    for (i = 0;  i < pProf->nEntries;  i++)
+        free (pProf->pEntry [i].pPath);
+    free (pProf->pEntry);
+    free (pProf->pHash);
+    memset (pProf, 0, sizeof (XTProfile));
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return 1 if the field pName holds a time in seconds, and 0 if it is a count.
+ */
+
+int XT_ProfIsTime (const char *pName)
+{
+    static const char  *pTimes [] = { "total", "self", "pruned_time", "cpu", "self_cpu", NULL };
+    unsigned            i;
+
+    for (i = 0;  pTimes [i] != NULL;  i++)
+        if (strcmp (pName, pTimes [i]) == 0)
+            return (1);
+    return (0);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Return a pointer to the last name in a call path (the function itself).
+ */
+
+const char *XT_ProfLeaf (const char *pPath)
+{
+    const char  *p;
+
+    return (((p = strrchr (pPath, ';')) != NULL) ? p + 1 : pPath);
+}
+
+
+
+/*-----------------------------------------------------------------------------
+ * Format a time in seconds the same way the xt library prints it.  The buffer
+ * must be at least 16 characters long.  Returns the buffer.
+ */
+
+const char *XT_ProfTime (double secs, char *pBuff)
+{
+    double    t = (secs < 0.0) ? -secs : secs;
+
+    if (t > 1.0)
+        sprintf (pBuff, "%.2f S", secs);
+    else if (t > 0.001)
+        sprintf (pBuff, "%.2f mS", secs * 1000.0);
+    else if (t > 0.000001)
+        sprintf (pBuff, "%.0f uS", secs * 1000000.0);
+    else
+        sprintf (pBuff, "%.0f nS", secs * 1000000000.0);
+    return (pBuff);
+}
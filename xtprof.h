@@ -0,0 +1,82 @@
+/*
+ * xtprof.h
+ *  Reading and writing of Execution Trace profile files (xt tools).
+ *  Copyright (C) 2020  Peter Harris   dilbert351@gmail.com
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+
+
+#ifndef _XTPROF_H_
+#define _XTPROF_H_
+
+#include <stdio.h>             // FILE
+
+#define XT_PROF_FIELDS   16                   /* Maximum fields per profile line.        */
+#define XT_PROF_NAMELEN  32                   /* Maximum length of a field name.         */
+#define XT_PROF_MAGIC    "# xt-profile 1"     /* First line of every profile file.       */
+#define XT_PROF_FLDHDR   "# fields:"          /* Second line lists the field names.      */
+
+
+
+/* A profile file is a text file written by the xt library (or by the tools).
+ * The first two lines identify the format and name the numeric fields, and
+ * every other line holds the fields for one call path followed by the path
+ * itself, names separated by ';':
+ *
+ *     # xt-profile 1
+ *     # fields: calls total self
+ *     3 6.000000000 0.000012000 main;func1
+ *
+ * All fields are additive, so profiles can be merged by adding the values of
+ * matching paths.  Paths are matched by name only, never by address.
+ */
+
+typedef struct xtprofentry_
+{
+    char        *pPath;                       /* Call path, names separated by ';'.     */
+    unsigned     next;                        /* Next entry in hash chain (+1).         */
+    double       value [XT_PROF_FIELDS];      /* Field values (indexed as field[]).     */
+}
+XTProfEntry;
+
+typedef struct xtprofile_
+{
+    unsigned     nFields;                     /* Number of fields in use.               */
+    char         field [XT_PROF_FIELDS][XT_PROF_NAMELEN];
+    XTProfEntry *pEntry;                      /* Array of entries.                      */
+    unsigned     nEntries;                    /* Number of entries in use.              */
+    unsigned     size;                        /* Number of entries allocated.           */
+    unsigned    *pHash;                       /* Hash table of entry indices (+1).      */
+    unsigned     nHash;                       /* Number of hash buckets (power of 2).   */
+}
+XTProfile;
+
+
+
+/*                    - - - -  FUNCTION PROTOTYPES  - - - -                         */
+
+int          XT_ProfRead        (const char *pFile, XTProfile *pProf);
+int          XT_ProfMerge       (XTProfile *pDst, const XTProfile *pSrc);
+int          XT_ProfWrite       (FILE *fp, const XTProfile *pProf);
+XTProfEntry *XT_ProfFind        (XTProfile *pProf, const char *pPath, int add);
+int          XT_ProfField       (XTProfile *pProf, const char *pName, int add);
+void         XT_ProfFree        (XTProfile *pProf);
+int          XT_ProfIsTime      (const char *pName);
+const char  *XT_ProfLeaf        (const char *pPath);
+const char  *XT_ProfTime        (double secs, char *pBuff);
+
+#endif  /* _XTPROF_H_ */